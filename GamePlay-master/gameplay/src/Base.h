@@ -230,10 +230,12 @@ using std::va_list;
         #define GLEW_STATIC
         #include <GL/glew.h>
         #define GP_USE_VAO
+        #define GP_USE_INSTANCING
 #elif __linux__
         #define GLEW_STATIC
         #include <GL/glew.h>
         #define GP_USE_VAO
+        #define GP_USE_INSTANCING
 #elif __APPLE__
     #include "TargetConditionals.h"
     #if TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR
@@ -272,6 +274,7 @@ using std::va_list;
 #define VERTEX_ATTRIBUTE_BLENDWEIGHTS_NAME          "a_blendWeights"
 #define VERTEX_ATTRIBUTE_BLENDINDICES_NAME          "a_blendIndices"
 #define VERTEX_ATTRIBUTE_TEXCOORD_PREFIX_NAME       "a_texCoord"
+#define VERTEX_ATTRIBUTE_INSTANCE_MATRIX_NAME       "a_instanceMatrix"
 
 // Hardware buffer
 namespace gameplay
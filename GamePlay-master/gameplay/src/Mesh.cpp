@@ -4,18 +4,21 @@
 #include "Effect.h"
 #include "Model.h"
 #include "Material.h"
+#include "VertexAttributeBinding.h"
 
 namespace gameplay
 {
 
 Mesh::Mesh(const VertexFormat& vertexFormat) 
-    : _vertexFormat(vertexFormat), _vertexCount(0), _vertexBuffer(0), _primitiveType(TRIANGLES), 
-      _partCount(0), _parts(NULL), _dynamic(false)
+    : _vertexFormat(vertexFormat), _vertexCount(0), _vertexBuffer(0), _instanceBuffer(0), _instanceCapacity(0),
+      _primitiveType(TRIANGLES), _partCount(0), _parts(NULL), _dynamic(false)
 {
 }
 
 Mesh::~Mesh()
 {
+    VertexAttributeBinding::releaseBindings(this);
+
     if (_parts)
     {
         for (unsigned int i = 0; i < _partCount; ++i)
@@ -30,6 +33,12 @@ Mesh::~Mesh()
         glDeleteBuffers(1, &_vertexBuffer);
         _vertexBuffer = 0;
     }
+
+    if (_instanceBuffer)
+    {
+        glDeleteBuffers(1, &_instanceBuffer);
+        _instanceBuffer = 0;
+    }
 }
 
 Mesh* Mesh::createMesh(const VertexFormat& vertexFormat, unsigned int vertexCount, bool dynamic)
@@ -251,6 +260,30 @@ bool Mesh::isDynamic() const
     return _dynamic;
 }
 
+VertexBufferHandle Mesh::getInstanceBuffer()
+{
+    if (_instanceBuffer == 0)
+    {
+        GL_ASSERT( glGenBuffers(1, &_instanceBuffer) );
+    }
+    return _instanceBuffer;
+}
+
+void Mesh::setInstanceData(const Matrix* matrices, unsigned int instanceCount)
+{
+    GL_ASSERT( glBindBuffer(GL_ARRAY_BUFFER, getInstanceBuffer()) );
+
+    if (instanceCount > _instanceCapacity)
+    {
+        GL_ASSERT( glBufferData(GL_ARRAY_BUFFER, sizeof(Matrix) * instanceCount, matrices, GL_DYNAMIC_DRAW) );
+        _instanceCapacity = instanceCount;
+    }
+    else if (instanceCount > 0)
+    {
+        GL_ASSERT( glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Matrix) * instanceCount, matrices) );
+    }
+}
+
 Mesh::PrimitiveType Mesh::getPrimitiveType() const
 {
     return _primitiveType;
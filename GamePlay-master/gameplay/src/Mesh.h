@@ -4,6 +4,7 @@
 #include "Ref.h"
 #include "VertexFormat.h"
 #include "Vector3.h"
+#include "Matrix.h"
 #include "BoundingBox.h"
 #include "BoundingSphere.h"
 
@@ -177,6 +178,26 @@ public:
      */
     bool isDynamic() const;
 
+    /**
+     * Returns a handle to the buffer holding the world matrix of every instance drawn by Model::drawInstanced.
+     *
+     * The buffer is created empty the first time it is asked for.
+     *
+     * @return The instance buffer object handle.
+     */
+    VertexBufferHandle getInstanceBuffer();
+
+    /**
+     * Sets the world matrices of the instances drawn by Model::drawInstanced.
+     *
+     * Effects declaring the VERTEX_ATTRIBUTE_INSTANCE_MATRIX_NAME attribute read one matrix per instance.
+     * The buffer only grows, so drawing fewer instances than before doesn't reallocate it.
+     *
+     * @param matrices The world matrices, one per instance.
+     * @param instanceCount The number of matrices.
+     */
+    void setInstanceData(const Matrix* matrices, unsigned int instanceCount);
+
     /**
      * Returns the primitive type of the vertices in the mesh.
      *
@@ -353,6 +374,8 @@ private:
     const VertexFormat _vertexFormat;
     unsigned int _vertexCount;
     VertexBufferHandle _vertexBuffer;
+    VertexBufferHandle _instanceBuffer;
+    unsigned int _instanceCapacity;
     PrimitiveType _primitiveType;
     unsigned int _partCount;
     MeshPart** _parts;
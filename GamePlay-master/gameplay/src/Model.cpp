@@ -250,7 +250,31 @@ void Model::setNode(Node* node)
     }
 }
 
-static bool drawWireframe(Mesh* mesh)
+static void drawArrays(GLenum mode, GLint first, GLsizei count, unsigned int instanceCount)
+{
+#ifdef GP_USE_INSTANCING
+    if (instanceCount > 0)
+    {
+        GL_ASSERT( glDrawArraysInstanced(mode, first, count, instanceCount) );
+        return;
+    }
+#endif
+    GL_ASSERT( glDrawArrays(mode, first, count) );
+}
+
+static void drawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices, unsigned int instanceCount)
+{
+#ifdef GP_USE_INSTANCING
+    if (instanceCount > 0)
+    {
+        GL_ASSERT( glDrawElementsInstanced(mode, count, type, indices, instanceCount) );
+        return;
+    }
+#endif
+    GL_ASSERT( glDrawElements(mode, count, type, indices) );
+}
+
+static bool drawWireframe(Mesh* mesh, unsigned int instanceCount)
 {
     switch (mesh->getPrimitiveType())
     {
@@ -259,7 +283,7 @@ static bool drawWireframe(Mesh* mesh)
             unsigned int vertexCount = mesh->getVertexCount();
             for (unsigned int i = 0; i < vertexCount; i += 3)
             {
-                GL_ASSERT( glDrawArrays(GL_LINE_LOOP, i, 3) );
+                drawArrays(GL_LINE_LOOP, i, 3, instanceCount);
             }
         }
         return true;
@@ -269,7 +293,7 @@ static bool drawWireframe(Mesh* mesh)
             unsigned int vertexCount = mesh->getVertexCount();
             for (unsigned int i = 2; i < vertexCount; ++i)
             {
-                GL_ASSERT( glDrawArrays(GL_LINE_LOOP, i-2, 3) );
+                drawArrays(GL_LINE_LOOP, i-2, 3, instanceCount);
             }
         }
         return true;
@@ -280,7 +304,7 @@ static bool drawWireframe(Mesh* mesh)
     }
 }
 
-static bool drawWireframe(MeshPart* part)
+static bool drawWireframe(MeshPart* part, unsigned int instanceCount)
 {
     unsigned int indexCount = part->getIndexCount();
     unsigned int indexSize = 0;
@@ -306,7 +330,7 @@ static bool drawWireframe(MeshPart* part)
         {
             for (size_t i = 0; i < indexCount; i += 3)
             {
-                GL_ASSERT( glDrawElements(GL_LINE_LOOP, 3, part->getIndexFormat(), ((const GLvoid*)(i*indexSize))) );
+                drawElements(GL_LINE_LOOP, 3, part->getIndexFormat(), ((const GLvoid*)(i*indexSize)), instanceCount);
             }
         }
         return true;
@@ -315,7 +339,7 @@ static bool drawWireframe(MeshPart* part)
         {
             for (size_t i = 2; i < indexCount; ++i)
             {
-                GL_ASSERT( glDrawElements(GL_LINE_LOOP, 3, part->getIndexFormat(), ((const GLvoid*)((i-2)*indexSize))) );
+                drawElements(GL_LINE_LOOP, 3, part->getIndexFormat(), ((const GLvoid*)((i-2)*indexSize)), instanceCount);
             }
         }
         return true;
@@ -326,7 +350,45 @@ static bool drawWireframe(MeshPart* part)
     }
 }
 
+static void bindMesh(Pass* pass, Mesh* mesh)
+{
+    // A material can be shared by models with different meshes, so the pass is pointed at the mesh being drawn.
+    // The bindings stay cached per mesh and effect, so this is a lookup after the first draw.
+    VertexAttributeBinding* binding = pass->getVertexAttributeBinding();
+    if (binding == NULL || binding->getMesh() != mesh)
+    {
+        binding = VertexAttributeBinding::create(mesh, pass->getEffect());
+        pass->setVertexAttributeBinding(binding);
+        SAFE_RELEASE(binding);
+    }
+}
+
 unsigned int Model::draw(bool wireframe)
+{
+    return drawParts(wireframe, 0);
+}
+
+unsigned int Model::drawInstanced(unsigned int instanceCount, bool wireframe)
+{
+    GP_ASSERT(isInstancingSupported());
+
+    if (instanceCount == 0)
+    {
+        return 0;
+    }
+    return drawParts(wireframe, instanceCount);
+}
+
+bool Model::isInstancingSupported()
+{
+#ifdef GP_USE_INSTANCING
+    return glDrawArraysInstanced && glDrawElementsInstanced && glVertexAttribDivisor;
+#else
+    return false;
+#endif
+}
+
+unsigned int Model::drawParts(bool wireframe, unsigned int instanceCount)
 {
     GP_ASSERT(_mesh);
 
@@ -343,11 +405,12 @@ unsigned int Model::draw(bool wireframe)
             {
                 Pass* pass = technique->getPassByIndex(i);
                 GP_ASSERT(pass);
+                bindMesh(pass, _mesh);
                 pass->bind();
                 GL_ASSERT( glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0) );
-                if (!wireframe || !drawWireframe(_mesh))
+                if (!wireframe || !drawWireframe(_mesh, instanceCount))
                 {
-                    GL_ASSERT( glDrawArrays(_mesh->getPrimitiveType(), 0, _mesh->getVertexCount()) );
+                    drawArrays(_mesh->getPrimitiveType(), 0, _mesh->getVertexCount(), instanceCount);
                 }
                 pass->unbind();
             }
@@ -371,11 +434,12 @@ unsigned int Model::draw(bool wireframe)
                 {
                     Pass* pass = technique->getPassByIndex(j);
                     GP_ASSERT(pass);
+                    bindMesh(pass, _mesh);
                     pass->bind();
                     GL_ASSERT( glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, part->_indexBuffer) );
-                    if (!wireframe || !drawWireframe(part))
+                    if (!wireframe || !drawWireframe(part, instanceCount))
                     {
-                        GL_ASSERT( glDrawElements(part->getPrimitiveType(), part->getIndexCount(), part->getIndexFormat(), 0) );
+                        drawElements(part->getPrimitiveType(), part->getIndexCount(), part->getIndexFormat(), 0, instanceCount);
                     }
                     pass->unbind();
                 }
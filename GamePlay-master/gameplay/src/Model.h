@@ -141,6 +141,27 @@ public:
      */
     unsigned int draw(bool wireframe = false);
 
+    /**
+     * Draws the mesh geometry once for every instance set with Mesh::setInstanceData.
+     *
+     * The materials are expected to use effects reading the world matrix from the
+     * VERTEX_ATTRIBUTE_INSTANCE_MATRIX_NAME attribute instead of a uniform.
+     *
+     * @param instanceCount The number of instances to draw.
+     * @param wireframe true to draw the mesh as wireframe.
+     *
+     * @return The number of mesh parts drawn.
+     * @see isInstancingSupported
+     */
+    unsigned int drawInstanced(unsigned int instanceCount, bool wireframe = false);
+
+    /**
+     * Determines if the renderer can draw instances.
+     *
+     * @return true if drawInstanced can be used; false otherwise.
+     */
+    static bool isInstancingSupported();
+
 private:
 
     /**
@@ -187,6 +208,11 @@ private:
 
     void validatePartCount();
 
+    /**
+     * Draws every part, instanced when instanceCount is greater than 0.
+     */
+    unsigned int drawParts(bool wireframe, unsigned int instanceCount);
+
     Mesh* _mesh;
     Material* _material;
     unsigned int _partCount;
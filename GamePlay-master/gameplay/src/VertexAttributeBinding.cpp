@@ -7,7 +7,7 @@ namespace gameplay
 {
 
 static GLuint __maxVertexAttribs = 0;
-static std::vector<VertexAttributeBinding*> __vertexAttributeBindingCache;
+static std::map<std::pair<Mesh*, Effect*>, VertexAttributeBinding*> __vertexAttributeBindingCache;
 
 VertexAttributeBinding::VertexAttributeBinding() :
     _handle(0), _attributes(NULL), _mesh(NULL), _effect(NULL)
@@ -17,13 +17,12 @@ VertexAttributeBinding::VertexAttributeBinding() :
 VertexAttributeBinding::~VertexAttributeBinding()
 {
     // Delete from the vertex attribute binding cache.
-    std::vector<VertexAttributeBinding*>::iterator itr = std::find(__vertexAttributeBindingCache.begin(), __vertexAttributeBindingCache.end(), this);
-    if (itr != __vertexAttributeBindingCache.end())
+    std::map<std::pair<Mesh*, Effect*>, VertexAttributeBinding*>::iterator itr = __vertexAttributeBindingCache.find(std::make_pair(_mesh, _effect));
+    if (itr != __vertexAttributeBindingCache.end() && itr->second == this)
     {
         __vertexAttributeBindingCache.erase(itr);
     }
 
-    SAFE_RELEASE(_mesh);
     SAFE_RELEASE(_effect);
     SAFE_DELETE_ARRAY(_attributes);
 
@@ -39,30 +38,40 @@ VertexAttributeBinding* VertexAttributeBinding::create(Mesh* mesh, Effect* effec
     GP_ASSERT(mesh);
 
     // Search for an existing vertex attribute binding that can be used.
-    VertexAttributeBinding* b;
-    for (size_t i = 0, count = __vertexAttributeBindingCache.size(); i < count; ++i)
+    std::map<std::pair<Mesh*, Effect*>, VertexAttributeBinding*>::iterator itr = __vertexAttributeBindingCache.find(std::make_pair(mesh, effect));
+    if (itr != __vertexAttributeBindingCache.end())
     {
-        b = __vertexAttributeBindingCache[i];
-        GP_ASSERT(b);
-        if (b->_mesh == mesh && b->_effect == effect)
-        {
-            // Found a match!
-            b->addRef();
-            return b;
-        }
+        // Found a match!
+        itr->second->addRef();
+        return itr->second;
     }
 
-    b = create(mesh, mesh->getVertexFormat(), 0, effect);
+    VertexAttributeBinding* b = create(mesh, mesh->getVertexFormat(), 0, effect);
 
-    // Add the new vertex attribute binding to the cache.
+    // Add the new vertex attribute binding to the cache, which holds on to it until the mesh is destroyed.
     if (b)
     {
-        __vertexAttributeBindingCache.push_back(b);
+        __vertexAttributeBindingCache[std::make_pair(mesh, effect)] = b;
+        b->addRef();
     }
 
     return b;
 }
 
+void VertexAttributeBinding::releaseBindings(Mesh* mesh)
+{
+    std::map<std::pair<Mesh*, Effect*>, VertexAttributeBinding*>::iterator itr = __vertexAttributeBindingCache.lower_bound(std::make_pair(mesh, (Effect*)NULL));
+    while (itr != __vertexAttributeBindingCache.end() && itr->first.first == mesh)
+    {
+        VertexAttributeBinding* b = itr->second;
+        __vertexAttributeBindingCache.erase(itr++);
+
+        // A pass may still hold the binding until it is pointed at another mesh.
+        b->_mesh = NULL;
+        b->release();
+    }
+}
+
 VertexAttributeBinding* VertexAttributeBinding::create(const VertexFormat& vertexFormat, void* vertexPointer, Effect* effect)
 {
     return create(NULL, vertexFormat, vertexPointer, effect);
@@ -129,11 +138,8 @@ VertexAttributeBinding* VertexAttributeBinding::create(Mesh* mesh, const VertexF
         b->_attributes = attribs;
     }
 
-    if (mesh)
-    {
-        b->_mesh = mesh;
-        mesh->addRef();
-    }
+    // The mesh isn't referenced, it releases its bindings when it is destroyed.
+    b->_mesh = mesh;
     
     b->_effect = effect;
     effect->addRef();
@@ -204,6 +210,27 @@ VertexAttributeBinding* VertexAttributeBinding::create(Mesh* mesh, const VertexF
         offset += e.size * sizeof(float);
     }
 
+#ifdef GP_USE_INSTANCING
+    // Instanced effects read a world matrix per instance from the mesh's instance buffer, one column per attribute.
+    gameplay::VertexAttribute instanceMatrix = effect->getVertexAttribute(VERTEX_ATTRIBUTE_INSTANCE_MATRIX_NAME);
+    if (instanceMatrix != -1)
+    {
+        if (b->_handle && glVertexAttribDivisor)
+        {
+            GL_ASSERT( glBindBuffer(GL_ARRAY_BUFFER, mesh->getInstanceBuffer()) );
+            for (GLuint column = 0; column < 4; ++column)
+            {
+                b->setVertexAttribPointer(instanceMatrix + column, 4, GL_FLOAT, GL_FALSE, (GLsizei)sizeof(Matrix), (void*)(column * 4 * sizeof(float)));
+                GL_ASSERT( glVertexAttribDivisor(instanceMatrix + column, 1) );
+            }
+        }
+        else
+        {
+            GP_WARN("Effect '%s' reads '%s' per instance, which needs a mesh and vertex array objects.", effect->getId(), VERTEX_ATTRIBUTE_INSTANCE_MATRIX_NAME);
+        }
+    }
+#endif
+
     if (b->_handle)
     {
         GL_ASSERT( glBindVertexArray(0) );
@@ -235,6 +262,11 @@ void VertexAttributeBinding::setVertexAttribPointer(GLuint indx, GLint size, GLe
     }
 }
 
+Mesh* VertexAttributeBinding::getMesh() const
+{
+    return _mesh;
+}
+
 void VertexAttributeBinding::bind()
 {
     if (_handle)
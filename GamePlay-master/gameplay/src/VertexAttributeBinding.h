@@ -31,6 +31,8 @@ class Effect;
  */
 class VertexAttributeBinding : public Ref
 {
+    friend class Mesh;
+
 public:
 
     /**
@@ -42,6 +44,12 @@ public:
      * stored in the returned VertexAttributeBinding, otherwise a client-side
      * array of vertex attribute bindings will be stored.
      *
+     * The cache keeps its own reference to every binding until the mesh is
+     * destroyed, so passes switching between meshes never recreate them.
+     *
+     * If the effect declares the VERTEX_ATTRIBUTE_INSTANCE_MATRIX_NAME attribute, it
+     * is bound to the instance buffer of the mesh and advances once per instance.
+     *
      * @param mesh The mesh.
      * @param effect The effect.
      * 
@@ -68,6 +76,13 @@ public:
      */
     static VertexAttributeBinding* create(const VertexFormat& vertexFormat, void* vertexPointer, Effect* effect);
 
+    /**
+     * Gets the mesh this binding reads its vertices from.
+     *
+     * @return The mesh, or NULL for a client-side binding or once the mesh is destroyed.
+     */
+    Mesh* getMesh() const;
+
     /**
      * Binds this vertex array object.
      */
@@ -108,6 +123,11 @@ private:
 
     static VertexAttributeBinding* create(Mesh* mesh, const VertexFormat& vertexFormat, void* vertexPointer, Effect* effect);
 
+    /**
+     * Releases the cached bindings of a mesh that is being destroyed.
+     */
+    static void releaseBindings(Mesh* mesh);
+
     void setVertexAttribPointer(GLuint indx, GLint size, GLenum type, GLboolean normalize, GLsizei stride, void* pointer);
 
     GLuint _handle;
@@ -0,0 +1,142 @@
+#include "AsyncSender.h"
+#include <cstring>
+#include <chrono>
+
+AsyncSender::AsyncSender(ComLib& comLib, ThreadPool& threadPool, size_t queueSize, int retryLimit) : mComLib(comLib), mThreadPool(threadPool) {
+	mRetryLimit = retryLimit;
+	mConnected = true;
+	mJobs.resize(queueSize > 0 ? queueSize : 1);
+	mHead = 0;
+	mTail = 0;
+	mSleeping = false;
+	mStopping = false;
+	mMessagesSent = 0;
+	mBytesSent = 0;
+	mRetries = 0;
+	mDropped = 0;
+	mStalls = 0;
+	mPeakQueued = 0;
+
+	mThread = std::thread(&AsyncSender::senderLoop, this);
+}
+
+AsyncSender::~AsyncSender() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWake.notify_one();
+	mThread.join();
+}
+
+void AsyncSender::send(const void* msg, const size_t msgSize) {
+	char* copy = new char[msgSize];
+	memcpy(copy, msg, msgSize);
+	sendOwned(copy, msgSize);
+}
+
+void AsyncSender::sendOwned(char* msg, const size_t msgSize) {
+	Job job;
+	job.msg = msg;
+	job.msgSize = msgSize;
+	push(job);
+}
+
+void AsyncSender::sendMesh(char* msg, const size_t msgSize, const size_t vertexOffset, MeshCapture* mesh) {
+	Job job;
+	job.msg = msg;
+	job.msgSize = msgSize;
+	job.vertexOffset = vertexOffset;
+	job.mesh = mesh;
+	push(job);
+}
+
+void AsyncSender::sendClip(ClipCapture* clip) {
+	Job job;
+	job.clip = clip;
+	push(job);
+}
+
+AsyncSender::Statistics AsyncSender::getStatistics() const {
+	Statistics statistics;
+	statistics.messagesSent = mMessagesSent;
+	statistics.bytesSent = mBytesSent;
+	statistics.retries = mRetries;
+	statistics.dropped = mDropped;
+	statistics.stalls = mStalls;
+	statistics.peakQueued = mPeakQueued;
+	return statistics;
+}
+
+void AsyncSender::push(const Job& job) {
+	size_t tail = mTail.load(std::memory_order_relaxed);
+	if (tail - mHead.load(std::memory_order_acquire) == mJobs.size()) {
+		mStalls++; //Backpressure, the main thread waits instead of queueing without limit
+		while (tail - mHead.load(std::memory_order_acquire) == mJobs.size()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	mJobs[tail % mJobs.size()] = job;
+	mTail.store(tail + 1); //Ordered against mSleeping, either the sender sees the job or we see it sleeping
+
+	size_t queued = tail + 1 - mHead.load(std::memory_order_acquire);
+	if (queued > mPeakQueued) {
+		mPeakQueued = queued;
+	}
+
+	if (mSleeping) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		mWake.notify_one();
+	}
+}
+
+void AsyncSender::senderLoop() {
+	while (true) {
+		size_t head = mHead.load(std::memory_order_relaxed);
+		if (head == mTail.load(std::memory_order_acquire)) {
+			if (mStopping) {
+				return; //Only stops once the queue is empty
+			}
+
+			std::unique_lock<std::mutex> lock(mMutex);
+			mSleeping = true;
+			mWake.wait(lock, [&] { return mStopping || head != mTail; });
+			mSleeping = false;
+			continue;
+		}
+
+		Job job = mJobs[head % mJobs.size()];
+		if (job.mesh != nullptr) {
+			//The main thread only copied the arrays, building the vertices is left for here
+			assembleVerticesParallel(job.mesh->getArrays(), (VertexMessage*)(job.msg + job.vertexOffset), mThreadPool);
+			delete job.mesh;
+		}
+		if (job.clip != nullptr) {
+			job.msg = job.clip->encode(job.msgSize);
+			delete job.clip;
+		}
+		transmit(job.msg, job.msgSize);
+		delete[] job.msg;
+
+		mHead.store(head + 1, std::memory_order_release); //Frees the slot for the main thread
+	}
+}
+
+bool AsyncSender::transmit(const char* msg, const size_t msgSize) {
+	int tryLimit = mConnected ? mRetryLimit : 1;
+	for (int tries = 0; tries < tryLimit; tries++) { //Keep trying while the viewer makes room in the buffer
+		if (mComLib.send(msg, msgSize) == true) {
+			mConnected = true;
+			mMessagesSent++;
+			mBytesSent += msgSize;
+			return true;
+		}
+		mRetries++;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	mConnected = false;
+	mDropped++;
+	return false;
+}
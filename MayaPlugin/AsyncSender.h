@@ -0,0 +1,76 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "ComLib.h"
+#include "MeshExtraction.h"
+#include "ClipCapture.h"
+#include "ThreadPool.h"
+
+/*
+ * Moves the encoding and sending of messages off Maya's main thread.
+ * Callbacks only push a job on a bounded single producer / single consumer ring,
+ * a background thread assembles any mesh vertices or clips and writes the result to the ComLib.
+ * Large meshes are assembled on the thread pool, shared with the main thread.
+ * Only Maya's main thread may push jobs.
+ */
+class AsyncSender {
+public:
+	struct Statistics {
+		size_t messagesSent = 0;
+		size_t bytesSent = 0;
+		size_t retries = 0; //Send attempts that found the buffer full
+		size_t dropped = 0; //Messages given up on, the viewer is most likely not running
+		size_t stalls = 0; //Times the main thread had to wait for room in the queue
+		size_t peakQueued = 0;
+	};
+
+	AsyncSender(ComLib& comLib, ThreadPool& threadPool, size_t queueSize, int retryLimit);
+	~AsyncSender(); //Sends everything still queued before returning
+
+	void send(const void* msg, const size_t msgSize); //Copies the message
+	void sendOwned(char* msg, const size_t msgSize); //Takes over a message allocated with new[]
+	//Takes over both, the assembled vertices of mesh are written to msg + vertexOffset before sending
+	void sendMesh(char* msg, const size_t msgSize, const size_t vertexOffset, MeshCapture* mesh);
+	void sendClip(ClipCapture* clip); //Takes over the samples, the message is encoded from them before sending
+
+	Statistics getStatistics() const;
+
+private:
+	struct Job {
+		char* msg = nullptr;
+		size_t msgSize = 0;
+		size_t vertexOffset = 0;
+		MeshCapture* mesh = nullptr;
+		ClipCapture* clip = nullptr;
+	};
+
+	void push(const Job& job);
+	void senderLoop();
+	bool transmit(const char* msg, const size_t msgSize);
+
+	ComLib& mComLib;
+	ThreadPool& mThreadPool;
+	int mRetryLimit;
+	bool mConnected; //Only touched by the sender thread, a dropped message stops the retrying until a send succeeds again
+
+	std::vector<Job> mJobs;
+	std::atomic<size_t> mHead; //Next job to send, written by the sender thread
+	std::atomic<size_t> mTail; //Next free slot, written by the main thread
+
+	std::thread mThread;
+	std::mutex mMutex; //Only used to sleep and wake the sender thread
+	std::condition_variable mWake;
+	std::atomic<bool> mSleeping;
+	std::atomic<bool> mStopping;
+
+	std::atomic<size_t> mMessagesSent;
+	std::atomic<size_t> mBytesSent;
+	std::atomic<size_t> mRetries;
+	std::atomic<size_t> mDropped;
+	size_t mStalls; //Only touched by the main thread
+	size_t mPeakQueued;
+};
@@ -0,0 +1,125 @@
+#include "CallbackRegistry.h"
+
+CallbackRegistry::CallbackRegistry() {
+	mNodeCount = 0;
+	mCallbackCount = 0;
+}
+
+CallbackRegistry::~CallbackRegistry() {
+	clear();
+}
+
+bool CallbackRegistry::has(const MObject& node, CALLBACK_SET set) const {
+	const NodeCallbacks* callbacks = find(node);
+	return callbacks != nullptr && (callbacks->sets & (1 << set)) != 0;
+}
+
+void CallbackRegistry::add(const MObject& node, CALLBACK_SET set, MCallbackId id) {
+	NodeCallbacks* callbacks = find(node);
+	if (callbacks == nullptr) {
+		MObjectHandle handle(node);
+		NodeCallbacks newCallbacks;
+		newCallbacks.node = handle;
+		newCallbacks.sets = 0;
+		std::vector<NodeCallbacks>& bucket = mNodes[handle.hashCode()];
+		bucket.push_back(newCallbacks);
+		callbacks = &bucket.back();
+		mNodeCount++;
+	}
+
+	callbacks->sets |= 1 << set;
+	callbacks->ids.push_back(id);
+	callbacks->idSets.push_back(set);
+	mCallbackCount++;
+}
+
+void CallbackRegistry::remove(const MObject& node, CALLBACK_SET set) {
+	NodeCallbacks* callbacks = find(node);
+	if (callbacks == nullptr || (callbacks->sets & (1 << set)) == 0) {
+		return;
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < callbacks->ids.size(); i++) {
+		if (callbacks->idSets[i] == set) {
+			MMessage::removeCallback(callbacks->ids[i]);
+			mCallbackCount--;
+		}
+		else {
+			callbacks->ids[kept] = callbacks->ids[i];
+			callbacks->idSets[kept] = callbacks->idSets[i];
+			kept++;
+		}
+	}
+	callbacks->ids.resize(kept);
+	callbacks->idSets.resize(kept);
+	callbacks->sets &= ~(1u << set);
+
+	if (callbacks->sets == 0) {
+		removeNode(node);
+	}
+}
+
+void CallbackRegistry::removeNode(const MObject& node) {
+	MObjectHandle handle(node);
+	auto it = mNodes.find(handle.hashCode());
+	if (it == mNodes.end()) {
+		return;
+	}
+
+	std::vector<NodeCallbacks>& bucket = it->second;
+	for (size_t i = 0; i < bucket.size(); i++) {
+		if (bucket[i].node == handle) {
+			for (size_t j = 0; j < bucket[i].ids.size(); j++) {
+				MMessage::removeCallback(bucket[i].ids[j]);
+			}
+			mCallbackCount -= bucket[i].ids.size();
+			mNodeCount--;
+
+			bucket[i] = bucket.back();
+			bucket.pop_back();
+			break;
+		}
+	}
+	if (bucket.empty()) {
+		mNodes.erase(it);
+	}
+}
+
+void CallbackRegistry::clear() {
+	for (auto& it : mNodes) {
+		for (size_t i = 0; i < it.second.size(); i++) {
+			for (size_t j = 0; j < it.second[i].ids.size(); j++) {
+				MMessage::removeCallback(it.second[i].ids[j]);
+			}
+		}
+	}
+	mNodes.clear();
+	mNodeCount = 0;
+	mCallbackCount = 0;
+}
+
+size_t CallbackRegistry::getNodeCount() const {
+	return mNodeCount;
+}
+
+size_t CallbackRegistry::getCallbackCount() const {
+	return mCallbackCount;
+}
+
+CallbackRegistry::NodeCallbacks* CallbackRegistry::find(const MObject& node) {
+	MObjectHandle handle(node);
+	auto it = mNodes.find(handle.hashCode());
+	if (it != mNodes.end()) {
+		for (size_t i = 0; i < it->second.size(); i++) {
+			if (it->second[i].node == handle) {
+				return &it->second[i];
+			}
+		}
+	}
+	return nullptr;
+}
+
+const CallbackRegistry::NodeCallbacks* CallbackRegistry::find(const MObject& node) const {
+	return const_cast<CallbackRegistry*>(this)->find(node);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+
+#include "maya_includes.h"
+
+/*
+ * Owns the callbacks registered on scene nodes, grouped per node and per set.
+ * A set is only registered once per node, and everything a node has is removed together when it is deleted.
+ */
+class CallbackRegistry {
+public:
+	enum CALLBACK_SET {
+		MESH_CALLBACKS,
+		PENDING_MESH_CALLBACKS, //Waits for a new mesh to become usable, removed once it has been sent
+		TRANSFORM_CALLBACKS,
+		LIGHT_CALLBACKS,
+		MATERIAL_CALLBACKS
+	};
+
+	CallbackRegistry();
+	~CallbackRegistry();
+
+	bool has(const MObject& node, CALLBACK_SET set) const;
+	void add(const MObject& node, CALLBACK_SET set, MCallbackId id);
+	void remove(const MObject& node, CALLBACK_SET set);
+	void removeNode(const MObject& node);
+	void clear(); //Removes every callback
+
+	size_t getNodeCount() const;
+	size_t getCallbackCount() const;
+
+private:
+	struct NodeCallbacks {
+		MObjectHandle node;
+		unsigned int sets; //CALLBACK_SET bits
+		std::vector<MCallbackId> ids;
+		std::vector<CALLBACK_SET> idSets; //The set every id belongs to
+	};
+
+	NodeCallbacks* find(const MObject& node);
+	const NodeCallbacks* find(const MObject& node) const;
+
+	std::unordered_map<unsigned int, std::vector<NodeCallbacks>> mNodes; //By node hash, the handle tells nodes with the same hash apart
+	size_t mNodeCount;
+	size_t mCallbackCount;
+};
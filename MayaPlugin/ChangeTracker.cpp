@@ -0,0 +1,48 @@
+#include "ChangeTracker.h"
+
+void ChangeTracker::markDirty(const MObject& node, CHANGE_KIND kind) {
+	if (mSuspended > 0) {
+		return;
+	}
+
+	MObjectHandle handle(node);
+	auto range = mIndices.equal_range(handle.hashCode());
+	for (auto it = range.first; it != range.second; ++it) { //The hash can be shared, the handle tells the nodes apart
+		Change& change = mChanges[it->second];
+		if (change.node == handle) {
+			change.kinds |= kind;
+			return;
+		}
+	}
+
+	Change change;
+	change.node = handle;
+	change.kinds = kind;
+	mIndices.emplace(handle.hashCode(), mChanges.size());
+	mChanges.push_back(change);
+}
+
+void ChangeTracker::takeChanges(std::vector<Change>& getChanges) {
+	getChanges.clear();
+	getChanges.swap(mChanges); //Keeps both allocations around for the next flush
+	mIndices.clear();
+}
+
+void ChangeTracker::clear() {
+	mChanges.clear();
+	mIndices.clear();
+}
+
+bool ChangeTracker::isEmpty() const {
+	return mChanges.empty();
+}
+
+void ChangeTracker::suspend() {
+	mSuspended++;
+}
+
+void ChangeTracker::resume() {
+	if (mSuspended > 0) {
+		mSuspended--;
+	}
+}
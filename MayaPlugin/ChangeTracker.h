@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+
+#include "maya_includes.h"
+
+/*
+ * Collects which nodes changed and how, so a burst of callbacks (a slider drag, a vertex being moved)
+ * turns into one extraction per node when the changes are flushed.
+ */
+class ChangeTracker {
+public:
+	enum CHANGE_KIND {
+		TRANSFORM_CHANGE = 1 << 0,
+		POINTS_CHANGE = 1 << 1,
+		TOPOLOGY_CHANGE = 1 << 2,
+		MATERIAL_CHANGE = 1 << 3,
+		CAMERA_CHANGE = 1 << 4,
+		LIGHT_CHANGE = 1 << 5,
+		POSE_CHANGE = 1 << 6 //Joints of a skinned mesh moved
+	};
+
+	struct Change {
+		MObjectHandle node;
+		unsigned int kinds; //CHANGE_KIND flags
+	};
+
+	void markDirty(const MObject& node, CHANGE_KIND kind);
+	//Hands over every change marked since the last call, in the order the nodes were first marked
+	void takeChanges(std::vector<Change>& getChanges);
+	void clear();
+	bool isEmpty() const;
+	//While suspended nothing is marked, for when the plugin moves the scene itself. Calls can be nested
+	void suspend();
+	void resume();
+
+private:
+	int mSuspended = 0;
+	std::vector<Change> mChanges;
+	std::unordered_multimap<unsigned int, size_t> mIndices; //Node hash to its entry in mChanges
+};
@@ -0,0 +1,84 @@
+#include "ClipCapture.h"
+#include <cstring>
+
+#include "ClipCodec.h"
+
+size_t ClipCapture::addTrack(const char* name, TrackType type, size_t channelCount) {
+	ClipTrackMessage track;
+	strncpy(track.name, name, NAME_SIZE - 1);
+	track.type = type;
+	track.channelCount = channelCount;
+	tracks.push_back(track);
+	samples.push_back(std::vector<float>());
+	samples.back().reserve(channelCount * info.frameCount);
+	vertices.push_back(std::vector<VertexMessage>());
+	pointIndices.push_back(std::vector<unsigned int>());
+	info.trackCount = tracks.size();
+	return tracks.size() - 1;
+}
+
+void ClipCapture::removeTrack(size_t track) {
+	tracks.erase(tracks.begin() + track);
+	samples.erase(samples.begin() + track);
+	vertices.erase(vertices.begin() + track);
+	pointIndices.erase(pointIndices.begin() + track);
+	info.trackCount = tracks.size();
+}
+
+bool ClipCapture::isConstant(size_t track) const {
+	size_t channelCount = tracks[track].channelCount;
+	const std::vector<float>& values = samples[track];
+	for (size_t i = channelCount; i < values.size(); i++) {
+		if (values[i] != values[i - channelCount]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t ClipCapture::getSizeBound() const {
+	//A 16 bit delta never takes more than three bytes
+	size_t size = sizeof(MessageType) + sizeof(ClipMessage) + sizeof(ClipTrackMessage) * tracks.size();
+	for (size_t i = 0; i < tracks.size(); i++) {
+		size += (sizeof(VertexMessage) + sizeof(unsigned int)) * tracks[i].vertexCount;
+		size += (sizeof(float) * 2 + info.frameCount * 3) * tracks[i].channelCount;
+	}
+	return size;
+}
+
+char* ClipCapture::encode(size_t& getSize) const {
+	std::vector<ClipTrackMessage> trackInfos = tracks;
+	std::vector<std::vector<unsigned char>> data(tracks.size());
+	getSize = sizeof(MessageType) + sizeof(ClipMessage) + sizeof(ClipTrackMessage) * tracks.size();
+	for (size_t i = 0; i < tracks.size(); i++) {
+		size_t verticesSize = sizeof(VertexMessage) * tracks[i].vertexCount;
+		size_t indicesSize = sizeof(unsigned int) * tracks[i].vertexCount;
+		data[i].resize(verticesSize + indicesSize);
+		if (verticesSize > 0) {
+			memcpy(data[i].data(), vertices[i].data(), verticesSize);
+			memcpy(data[i].data() + verticesSize, pointIndices[i].data(), indicesSize);
+		}
+
+		for (size_t channel = 0; channel < tracks[i].channelCount; channel++) {
+			encodeChannel(samples[i].data() + channel, info.frameCount, tracks[i].channelCount, data[i]);
+		}
+		trackInfos[i].dataSize = data[i].size();
+		getSize += data[i].size();
+	}
+
+	MessageType type = CLIP;
+	char* msg = new char[getSize];
+	char* section = msg;
+
+	memcpy(section, &type, sizeof(MessageType));
+	section += sizeof(MessageType);
+	memcpy(section, &info, sizeof(ClipMessage));
+	section += sizeof(ClipMessage);
+	memcpy(section, trackInfos.data(), sizeof(ClipTrackMessage) * trackInfos.size());
+	section += sizeof(ClipTrackMessage) * trackInfos.size();
+	for (size_t i = 0; i < data.size(); i++) {
+		memcpy(section, data[i].data(), data[i].size());
+		section += data[i].size();
+	}
+	return msg;
+}
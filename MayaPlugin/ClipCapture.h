@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "MessageTypes.h"
+
+//Samples of a baked frame range, kept until the sender thread has encoded them into a CLIP message
+struct ClipCapture {
+	ClipMessage info;
+	std::vector<ClipTrackMessage> tracks;
+	std::vector<std::vector<float>> samples; //channelCount values per frame for every track
+	std::vector<std::vector<VertexMessage>> vertices; //Only filled in for POINTS_TRACK
+	std::vector<std::vector<unsigned int>> pointIndices; //Point of every vertex, only for POINTS_TRACK
+
+	size_t addTrack(const char* name, TrackType type, size_t channelCount); //Returns the index of the track
+	void removeTrack(size_t track);
+	bool isConstant(size_t track) const; //Every frame holds the same values
+	size_t getSizeBound() const; //The encoded message is never larger than this
+	char* encode(size_t& getSize) const; //The whole message, allocated with new[]
+};
@@ -0,0 +1,92 @@
+#include "ContentHash.h"
+#include <cstring>
+
+//Constants and steps of XXH64
+const unsigned long long PRIME1 = 11400714785074694791ULL;
+const unsigned long long PRIME2 = 14029467366897019727ULL;
+const unsigned long long PRIME3 = 1609587929392839161ULL;
+const unsigned long long PRIME4 = 9650029242287828579ULL;
+const unsigned long long PRIME5 = 2870177450012600261ULL;
+
+static unsigned long long rotateLeft(unsigned long long value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static unsigned long long read64(const unsigned char* bytes) {
+	unsigned long long value;
+	memcpy(&value, bytes, sizeof(value)); //The arrays are not always 8 byte aligned
+	return value;
+}
+
+static unsigned int read32(const unsigned char* bytes) {
+	unsigned int value;
+	memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+static unsigned long long mixRound(unsigned long long accumulator, unsigned long long input) {
+	accumulator += input * PRIME2;
+	accumulator = rotateLeft(accumulator, 31);
+	return accumulator * PRIME1;
+}
+
+static unsigned long long mergeRound(unsigned long long hash, unsigned long long accumulator) {
+	hash ^= mixRound(0, accumulator);
+	return hash * PRIME1 + PRIME4;
+}
+
+unsigned long long hashBytes(const void* data, size_t size, unsigned long long seed) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	const unsigned char* end = bytes + size;
+	unsigned long long hash;
+
+	if (size >= 32) { //Four independent lanes, which is what makes it fast on big arrays
+		unsigned long long lane1 = seed + PRIME1 + PRIME2;
+		unsigned long long lane2 = seed + PRIME2;
+		unsigned long long lane3 = seed;
+		unsigned long long lane4 = seed - PRIME1;
+		const unsigned char* limit = end - 32;
+		do {
+			lane1 = mixRound(lane1, read64(bytes));
+			lane2 = mixRound(lane2, read64(bytes + 8));
+			lane3 = mixRound(lane3, read64(bytes + 16));
+			lane4 = mixRound(lane4, read64(bytes + 24));
+			bytes += 32;
+		} while (bytes <= limit);
+
+		hash = rotateLeft(lane1, 1) + rotateLeft(lane2, 7) + rotateLeft(lane3, 12) + rotateLeft(lane4, 18);
+		hash = mergeRound(hash, lane1);
+		hash = mergeRound(hash, lane2);
+		hash = mergeRound(hash, lane3);
+		hash = mergeRound(hash, lane4);
+	}
+	else {
+		hash = seed + PRIME5;
+	}
+	hash += size;
+
+	//The remaining bytes
+	while (bytes + 8 <= end) {
+		hash ^= mixRound(0, read64(bytes));
+		hash = rotateLeft(hash, 27) * PRIME1 + PRIME4;
+		bytes += 8;
+	}
+	if (bytes + 4 <= end) {
+		hash ^= read32(bytes) * PRIME1;
+		hash = rotateLeft(hash, 23) * PRIME2 + PRIME3;
+		bytes += 4;
+	}
+	while (bytes < end) {
+		hash ^= (*bytes) * PRIME5;
+		hash = rotateLeft(hash, 11) * PRIME1;
+		bytes++;
+	}
+
+	//Avalanche
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include <cstddef>
+
+//64-bit xxHash of the bytes, chain several arrays by passing the previous hash as the seed
+unsigned long long hashBytes(const void* data, size_t size, unsigned long long seed = 0);
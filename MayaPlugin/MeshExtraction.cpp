@@ -0,0 +1,241 @@
+#include "MeshExtraction.h"
+#include "ContentHash.h"
+
+const size_t PARALLEL_POLYGON_THRESHOLD = 4096; //Smaller meshes are assembled faster than the threads can be woken up
+const size_t RANGES_PER_THREAD = 4; //Some extra ranges so a thread that finishes early can take over work
+
+MeshArrays MeshCapture::getArrays() const {
+	MeshArrays arrays;
+	arrays.polygonCount = polygonCounts.size();
+	arrays.polygonCounts = polygonCounts.data();
+	arrays.polygonVertices = polygonVertices.data();
+	arrays.triangleCounts = triangleCounts.data();
+	arrays.triangleOffsets = triangleOffsets.data();
+	arrays.normalIds = normalIds.data();
+	arrays.uvCounts = uvCounts.data();
+	arrays.uvIds = uvIds.data();
+	arrays.points = points.data();
+	arrays.normals = normals.data();
+	arrays.us = us.data();
+	arrays.vs = vs.data();
+	arrays.polygonParts = polygonParts.empty() ? nullptr : polygonParts.data();
+	arrays.partCount = partCount;
+	return arrays;
+}
+
+size_t MeshCapture::getCornerCount() const {
+	return triangleOffsets.size();
+}
+
+unsigned long long MeshCapture::getHash() const {
+	//The topology arrays are hashed as well, the same points can be connected differently
+	unsigned long long hash = hashBytes(polygonCounts.data(), polygonCounts.size() * sizeof(int));
+	hash = hashBytes(polygonVertices.data(), polygonVertices.size() * sizeof(int), hash);
+	hash = hashBytes(triangleCounts.data(), triangleCounts.size() * sizeof(int), hash);
+	hash = hashBytes(triangleOffsets.data(), triangleOffsets.size() * sizeof(int), hash);
+	hash = hashBytes(normalIds.data(), normalIds.size() * sizeof(int), hash);
+	hash = hashBytes(uvCounts.data(), uvCounts.size() * sizeof(int), hash);
+	hash = hashBytes(uvIds.data(), uvIds.size() * sizeof(int), hash);
+	hash = hashBytes(points.data(), points.size() * sizeof(float), hash);
+	hash = hashBytes(normals.data(), normals.size() * sizeof(float), hash);
+	hash = hashBytes(us.data(), us.size() * sizeof(float), hash);
+	hash = hashBytes(vs.data(), vs.size() * sizeof(float), hash);
+	return hashBytes(polygonParts.data(), polygonParts.size() * sizeof(int), hash); //Moving faces to another part reorders the vertices
+}
+
+std::vector<PolygonRange> splitPolygons(const MeshArrays& mesh, size_t rangeCount) {
+	std::vector<PolygonRange> ranges;
+	if (mesh.polygonCount == 0 || rangeCount == 0) {
+		return ranges;
+	}
+
+	size_t rangeSize = (mesh.polygonCount + rangeCount - 1) / rangeCount;
+	size_t faceVertexCount = 0; //Face-vertices and UVs of the range being built
+	size_t uvCount = 0;
+	ranges.reserve(rangeCount);
+
+	//Only the offsets are summed up here, which is much cheaper than assembling the vertices
+	PolygonRange range;
+	for (size_t polygon = 0; polygon < mesh.polygonCount; polygon++) {
+		if (range.polygonCount == rangeSize) {
+			ranges.push_back(range);
+			range.firstPolygon = polygon;
+			range.polygonCount = 0;
+			range.firstCorner += range.cornerCount;
+			range.cornerCount = 0;
+			range.firstFaceVertex += faceVertexCount;
+			range.firstUV += uvCount;
+			faceVertexCount = 0;
+			uvCount = 0;
+		}
+		range.polygonCount++;
+		range.cornerCount += (size_t)mesh.triangleCounts[polygon] * 3;
+		faceVertexCount += mesh.polygonCounts[polygon];
+		uvCount += mesh.uvCounts[polygon];
+	}
+	ranges.push_back(range);
+
+	return ranges;
+}
+
+void assembleRange(const MeshArrays& mesh, const PolygonRange& range, VertexMessage* vertices, const size_t* polygonStarts) {
+	size_t counter = range.firstCorner;
+	size_t cornerOffset = range.firstCorner; //First triangle corner of the current polygon
+	size_t faceVertexOffset = range.firstFaceVertex; //First face-vertex of the current polygon
+	size_t uvOffset = range.firstUV; //First assigned UV of the current polygon
+
+	for (size_t polygon = range.firstPolygon; polygon < range.firstPolygon + range.polygonCount; polygon++) {
+		size_t cornerCount = (size_t)mesh.triangleCounts[polygon] * 3;
+		bool hasUVs = mesh.uvCounts[polygon] > 0;
+		if (polygonStarts != nullptr) {
+			counter = polygonStarts[polygon];
+		}
+
+		for (size_t corner = 0; corner < cornerCount; corner++) {
+			int localIndex = mesh.triangleOffsets[cornerOffset + corner]; //Already face-relative, no searching needed
+			size_t faceVertex = faceVertexOffset + localIndex;
+			VertexMessage& vertex = vertices[counter++];
+
+			const float* point = &mesh.points[mesh.polygonVertices[faceVertex] * 3];
+			vertex.pos[0] = point[0];
+			vertex.pos[1] = point[1];
+			vertex.pos[2] = point[2];
+
+			const float* normal = &mesh.normals[mesh.normalIds[faceVertex] * 3];
+			vertex.normal[0] = normal[0];
+			vertex.normal[1] = normal[1];
+			vertex.normal[2] = normal[2];
+
+			if (hasUVs) {
+				int uvId = mesh.uvIds[uvOffset + localIndex];
+				vertex.uv[0] = mesh.us[uvId];
+				vertex.uv[1] = mesh.vs[uvId];
+			}
+			else {
+				vertex.uv[0] = 0.0f;
+				vertex.uv[1] = 0.0f;
+			}
+		}
+
+		cornerOffset += cornerCount;
+		faceVertexOffset += mesh.polygonCounts[polygon];
+		uvOffset += mesh.uvCounts[polygon];
+	}
+}
+
+std::vector<size_t> countPartCorners(const MeshArrays& mesh) {
+	if (mesh.polygonParts == nullptr) {
+		std::vector<size_t> corners(1, 0);
+		for (size_t polygon = 0; polygon < mesh.polygonCount; polygon++) {
+			corners[0] += (size_t)mesh.triangleCounts[polygon] * 3;
+		}
+		return corners;
+	}
+
+	std::vector<size_t> corners(mesh.partCount, 0);
+	for (size_t polygon = 0; polygon < mesh.polygonCount; polygon++) {
+		corners[mesh.polygonParts[polygon]] += (size_t)mesh.triangleCounts[polygon] * 3;
+	}
+	return corners;
+}
+
+std::vector<size_t> getPolygonStarts(const MeshArrays& mesh) {
+	//Every part starts where the previous one ends, its polygons then follow each other in polygon order
+	std::vector<size_t> partStarts = countPartCorners(mesh);
+	size_t start = 0;
+	for (size_t part = 0; part < partStarts.size(); part++) {
+		size_t corners = partStarts[part];
+		partStarts[part] = start;
+		start += corners;
+	}
+
+	std::vector<size_t> polygonStarts(mesh.polygonCount);
+	for (size_t polygon = 0; polygon < mesh.polygonCount; polygon++) {
+		size_t& partStart = partStarts[mesh.polygonParts != nullptr ? mesh.polygonParts[polygon] : 0];
+		polygonStarts[polygon] = partStart;
+		partStart += (size_t)mesh.triangleCounts[polygon] * 3;
+	}
+	return polygonStarts;
+}
+
+size_t assembleVertices(const MeshArrays& mesh, VertexMessage* vertices) {
+	std::vector<PolygonRange> ranges = splitPolygons(mesh, 1);
+	if (ranges.empty()) {
+		return 0;
+	}
+
+	std::vector<size_t> polygonStarts;
+	if (mesh.polygonParts != nullptr) {
+		polygonStarts = getPolygonStarts(mesh);
+	}
+	assembleRange(mesh, ranges[0], vertices, polygonStarts.empty() ? nullptr : polygonStarts.data());
+	return ranges[0].cornerCount;
+}
+
+size_t assembleVerticesParallel(const MeshArrays& mesh, VertexMessage* vertices, ThreadPool& pool) {
+	if (mesh.polygonCount < PARALLEL_POLYGON_THRESHOLD || pool.getThreadCount() == 1) {
+		return assembleVertices(mesh, vertices);
+	}
+
+	//Every range writes to its own part of the output, so the threads never touch the same memory
+	//With parts the ranges are scattered over the output, but every polygon still has its own corners
+	std::vector<PolygonRange> ranges = splitPolygons(mesh, pool.getThreadCount() * RANGES_PER_THREAD);
+	std::vector<size_t> polygonStarts;
+	if (mesh.polygonParts != nullptr) {
+		polygonStarts = getPolygonStarts(mesh);
+	}
+	pool.run(ranges.size(), [&](size_t index) {
+		assembleRange(mesh, ranges[index], vertices, polygonStarts.empty() ? nullptr : polygonStarts.data());
+	});
+
+	return ranges.back().firstCorner + ranges.back().cornerCount;
+}
+
+SkinWeightMessage reduceInfluences(const double* weights, size_t influenceCount, const int* jointIndices) {
+	SkinWeightMessage pointWeights;
+	int strongest[4] = { -1, -1, -1, -1 };
+
+	//Insertion into the four slots, most points only have a handful of influences with any weight
+	for (size_t influence = 0; influence < influenceCount; influence++) {
+		float weight = (float)weights[influence];
+		if (weight <= pointWeights.weights[3]) {
+			continue;
+		}
+
+		int slot = 3;
+		while (slot > 0 && weight > pointWeights.weights[slot - 1]) {
+			pointWeights.weights[slot] = pointWeights.weights[slot - 1];
+			strongest[slot] = strongest[slot - 1];
+			slot--;
+		}
+		pointWeights.weights[slot] = weight;
+		strongest[slot] = (int)influence;
+	}
+
+	float sum = pointWeights.weights[0] + pointWeights.weights[1] + pointWeights.weights[2] + pointWeights.weights[3];
+	for (int slot = 0; slot < 4; slot++) {
+		if (strongest[slot] >= 0) {
+			pointWeights.joints[slot] = (float)jointIndices[strongest[slot]];
+			pointWeights.weights[slot] /= sum;
+		}
+	}
+	return pointWeights;
+}
+
+void assemblePointIndices(const MeshArrays& mesh, unsigned int* pointIndices) {
+	std::vector<size_t> polygonStarts = getPolygonStarts(mesh);
+	size_t cornerOffset = 0;
+	size_t faceVertexOffset = 0;
+
+	for (size_t polygon = 0; polygon < mesh.polygonCount; polygon++) {
+		size_t cornerCount = (size_t)mesh.triangleCounts[polygon] * 3;
+		size_t counter = polygonStarts[polygon];
+		for (size_t corner = 0; corner < cornerCount; corner++) {
+			size_t faceVertex = faceVertexOffset + mesh.triangleOffsets[cornerOffset + corner];
+			pointIndices[counter++] = (unsigned int)mesh.polygonVertices[faceVertex];
+		}
+
+		cornerOffset += cornerCount;
+		faceVertexOffset += mesh.polygonCounts[polygon];
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "MessageTypes.h"
+#include "ThreadPool.h"
+
+/*
+ * Maya independent view of a mesh, laid out like the bulk arrays MFnMesh returns.
+ * Everything indexed per face-vertex follows the polygon order of polygonCounts,
+ * so a triangle corner can be mapped straight to its face-vertex.
+ */
+struct MeshArrays {
+	size_t polygonCount = 0;
+	const int* polygonCounts = nullptr; //Vertices per polygon, from getVertices
+	const int* polygonVertices = nullptr; //Point id for every face-vertex, from getVertices
+	const int* triangleCounts = nullptr; //Triangles per polygon, from getTriangleOffsets
+	const int* triangleOffsets = nullptr; //Face-relative vertex for every triangle corner, from getTriangleOffsets
+	const int* normalIds = nullptr; //Normal id for every face-vertex, from getNormalIds
+	const int* uvCounts = nullptr; //Assigned UVs per polygon, 0 when the polygon has none, from getAssignedUVs
+	const int* uvIds = nullptr; //UV id for every face-vertex of the polygons with UVs, from getAssignedUVs
+	const float* points = nullptr; //x, y, z per point
+	const float* normals = nullptr; //x, y, z per normal
+	const float* us = nullptr;
+	const float* vs = nullptr;
+	const int* polygonParts = nullptr; //Part of every polygon, the vertices of each part are kept together when set
+	size_t partCount = 0;
+};
+
+//Owning copy of the bulk arrays, lets a mesh be assembled after Maya has moved on
+struct MeshCapture {
+	std::vector<int> polygonCounts;
+	std::vector<int> polygonVertices;
+	std::vector<int> triangleCounts;
+	std::vector<int> triangleOffsets;
+	std::vector<int> normalIds;
+	std::vector<int> uvCounts;
+	std::vector<int> uvIds;
+	std::vector<float> points;
+	std::vector<float> normals;
+	std::vector<float> us;
+	std::vector<float> vs;
+	std::vector<int> polygonParts; //Empty when the whole mesh is one part
+	size_t partCount = 0;
+
+	MeshArrays getArrays() const;
+	size_t getCornerCount() const; //Vertices the assembled mesh will have
+	unsigned long long getHash() const; //Changes whenever anything the vertices are built from changes
+};
+
+//A run of polygons with its offsets into the mesh arrays, so it can be assembled on its own
+struct PolygonRange {
+	size_t firstPolygon = 0;
+	size_t polygonCount = 0;
+	size_t firstCorner = 0; //Also where the range starts writing in the output
+	size_t cornerCount = 0;
+	size_t firstFaceVertex = 0;
+	size_t firstUV = 0;
+};
+
+//Splits the mesh into at most rangeCount ranges with roughly the same amount of polygons
+std::vector<PolygonRange> splitPolygons(const MeshArrays& mesh, size_t rangeCount);
+//Without polygonStarts the range is written in polygon order from range.firstCorner
+void assembleRange(const MeshArrays& mesh, const PolygonRange& range, VertexMessage* vertices, const size_t* polygonStarts = nullptr);
+
+//Triangle corners in each part, a mesh without parts is a single part
+std::vector<size_t> countPartCorners(const MeshArrays& mesh);
+//Output vertex of the first corner of every polygon, so that the parts end up after each other in part order
+std::vector<size_t> getPolygonStarts(const MeshArrays& mesh);
+
+//Writes one vertex per triangle corner and returns how many were written.
+//vertices needs room for every entry in triangleOffsets
+size_t assembleVertices(const MeshArrays& mesh, VertexMessage* vertices);
+size_t assembleVerticesParallel(const MeshArrays& mesh, VertexMessage* vertices, ThreadPool& pool);
+
+//Keeps the four strongest of the influenceCount weights of a point, scaled to sum up to one again.
+//jointIndices maps every influence to the joint index that is sent
+SkinWeightMessage reduceInfluences(const double* weights, size_t influenceCount, const int* jointIndices);
+//Writes the point of every triangle corner, in the same order as assembleVertices
+void assemblePointIndices(const MeshArrays& mesh, unsigned int* pointIndices);
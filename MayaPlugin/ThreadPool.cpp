@@ -0,0 +1,91 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+	mTask = nullptr;
+	mTaskCount = 0;
+	mNextTask = 0;
+	mFinishedTasks = 0;
+	mActiveWorkers = 0;
+	mGeneration = 0;
+	mStopping = false;
+
+	for (unsigned int i = 0; i < threadCount; i++) {
+		mWorkers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWake.notify_all();
+
+	for (size_t i = 0; i < mWorkers.size(); i++) {
+		mWorkers[i].join();
+	}
+}
+
+void ThreadPool::run(size_t taskCount, const std::function<void(size_t)>& task) {
+	if (taskCount == 0) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> runLock(mRunMutex); //The pool is shared, callers on other threads wait their turn
+	std::unique_lock<std::mutex> lock(mMutex);
+	mTask = &task;
+	mTaskCount = taskCount;
+	mNextTask = 0;
+	mFinishedTasks = 0;
+	mGeneration++;
+	lock.unlock();
+	mWake.notify_all();
+
+	size_t finished = runTasks(&task, taskCount); //The calling thread helps instead of only waiting
+
+	lock.lock();
+	mFinishedTasks += finished;
+	mDone.wait(lock, [this] { return mFinishedTasks == mTaskCount && mActiveWorkers == 0; });
+	mTask = nullptr;
+}
+
+unsigned int ThreadPool::getThreadCount() const {
+	return (unsigned int)mWorkers.size() + 1;
+}
+
+void ThreadPool::workerLoop() {
+	size_t generation = 0;
+	while (true) {
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWake.wait(lock, [&] { return mStopping || mGeneration != generation; });
+		if (mStopping) {
+			return;
+		}
+		generation = mGeneration;
+		if (mTask == nullptr) { //Woke up after the run was already finished
+			continue;
+		}
+
+		const std::function<void(size_t)>* task = mTask;
+		size_t taskCount = mTaskCount;
+		mActiveWorkers++;
+		lock.unlock();
+
+		size_t finished = runTasks(task, taskCount);
+
+		lock.lock();
+		mFinishedTasks += finished;
+		mActiveWorkers--;
+		lock.unlock();
+		mDone.notify_all();
+	}
+}
+
+size_t ThreadPool::runTasks(const std::function<void(size_t)>* task, size_t taskCount) {
+	size_t finished = 0;
+	for (size_t index = mNextTask++; index < taskCount; index = mNextTask++) {
+		(*task)(index);
+		finished++;
+	}
+	return finished;
+}
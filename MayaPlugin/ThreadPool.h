@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+class ThreadPool {
+public:
+	ThreadPool(unsigned int threadCount);
+	~ThreadPool();
+
+	//Runs task(0) to task(taskCount - 1) on the workers and the calling thread, returns once every task is done.
+	//Runs from different threads take turns
+	void run(size_t taskCount, const std::function<void(size_t)>& task);
+	unsigned int getThreadCount() const; //Including the calling thread
+
+private:
+	void workerLoop();
+	size_t runTasks(const std::function<void(size_t)>* task, size_t taskCount);
+
+	std::vector<std::thread> mWorkers;
+	std::mutex mRunMutex; //Held for a whole run
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mDone;
+
+	const std::function<void(size_t)>* mTask;
+	size_t mTaskCount;
+	std::atomic<size_t> mNextTask;
+	size_t mFinishedTasks;
+	size_t mActiveWorkers; //Workers still inside a run, a new run can't start before they are out
+	size_t mGeneration; //Increased for every run so sleeping workers know there is new work
+	bool mStopping;
+};
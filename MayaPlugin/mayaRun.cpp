@@ -2,44 +2,127 @@
 #include <iostream>
 #include <algorithm>
 #include <vector>
-#include <queue>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
 
 #include "ComLib.h"
 #include "MessageTypes.h"
-
-MCallbackIdArray callbackIdArray;
-static MCallbackId meshAddedCallbackID;
+#include "MeshExtraction.h"
+#include "ThreadPool.h"
+#include "AsyncSender.h"
+#include "ChangeTracker.h"
+#include "ContentHash.h"
+#include "CallbackRegistry.h"
+#include "ClipCapture.h"
+
+MCallbackIdArray callbackIdArray; //Callbacks that are not tied to a node
+CallbackRegistry g_callbacks; //Callbacks on scene nodes, removed together with the node
+size_t g_reportedCallbackCount = 0;
 
 enum NODE_TYPE { TRANSFORM, MESH };
 //MTimer gTimer;
 double timeElapsed = 0;
 
-// keep track of created meshes to maintain them
-std::queue<MObject> newMeshes;
+// materials that have been sent to the viewer, only these have callbacks registered
+std::vector<std::string> definedMaterials;
 
 ComLib g_comlib("MayaComLib", 200, ComLib::PRODUCER);
+ComLib g_viewerComlib("ViewerComLib", 8, ComLib::CONSUMER); //The viewer lists the content it already has here
+ThreadPool* g_threadPool = NULL; //Created when the plugin is loaded, threads can't be started while the DLL itself is being loaded
+AsyncSender* g_sender = NULL; //Every message goes through here so the callbacks never wait on the viewer
+AsyncSender::Statistics g_reportedStatistics; //What the timer last printed
+const size_t SEND_QUEUE_SIZE = 256; //Messages that can wait for the sender thread before the main thread has to wait
+ChangeTracker g_changes; //Callbacks only mark what changed, flushChanges extracts and sends it
+const float FLUSH_RATE = 60.0f; //How many times per second the marked changes are flushed
+//Content hashes of what the viewer has, by name, nothing is resent while the hash stays the same
+std::unordered_map<std::string, unsigned long long> g_meshHashes;
+std::unordered_map<std::string, unsigned long long> g_materialHashes;
+std::unordered_set<unsigned long long> g_meshContent; //Mesh hashes the viewer has vertices for, a duplicate of one is sent without them
+const int HASH_REPLY_TIMEOUT = 250; //Milliseconds to wait for the viewer to list its content when the plugin is loaded
+
+//Skinned meshes are sent once in their bind pose, after that only the poses of their joints are streamed
+struct SkinBinding {
+	MObjectHandle mesh;
+	MObjectHandle skinCluster;
+	MDagPathArray joints; //Parents before their children
+	std::vector<int> parents; //Index in joints, -1 for joints without an ancestor in the skin
+	std::vector<int> jointIndices; //Index in joints of every influence of the skin cluster
+	unsigned long long bindHash = 0; //Joints and bind poses, part of the mesh content hash
+	unsigned long long poseHash = 0; //Last pose sent
+};
+std::vector<SkinBinding> g_skins;
+std::unordered_map<std::string, CameraMessage> g_panelCameras; //Last camera state seen in every panel
+std::chrono::steady_clock::time_point g_lastCameraSend;
+const float CAMERA_EPSILON = 0.0001f; //Smaller differences in any camera value are not worth sending
+const float CAMERA_RATE = 30.0f; //Max camera updates per second, 0 sends one every flush
+const size_t SNAPSHOT_CHUNK_SIZE = 32 << 20; //Max size in bytes of the vertex section in one scene snapshot message
+const int SEND_RETRY_LIMIT = 2000; //Roughly how many milliseconds to wait for room in the buffer before giving up
+const float LIGHT_CUTOFF = 1.0f / 256.0f; //A decaying light is treated as out of range once it is this dim
+const size_t MAX_CLIP_FRAMES = 1000; //Longer playback ranges are cut short, every sample is kept until the clip is sent
+const size_t CLIP_SIZE_LIMIT = 64 << 20; //The largest point tracks are left out of clips that would grow bigger than this
 
 //Function declarations
 EXPORT MStatus initializePlugin(MObject obj);
 EXPORT MStatus uninitializePlugin(MObject obj);
 MStatus registerAllCallbacks();
 MStatus checkScene();
-MIntArray getlocalIndex(MIntArray& getVerts, MIntArray& getTris);
-void getVertexData(std::vector<VertexMessage>& getVertices, MFnMesh& mesh);
+void sendSceneSnapshot(std::vector<CameraMessage>& cameras, std::vector<MaterialMessage>& materials, std::vector<TransformMessage>& transforms, std::vector<LightMessage>& lights, std::vector<MeshMessage>& meshes, std::vector<MeshPartMessage>& parts, std::vector<VertexMessage>& vertices);
+void copyIntArray(MIntArray& source, std::vector<int>& destination);
+void captureMesh(MeshCapture& getCapture, MFnMesh& mesh, MObjectArray& getShaders);
+void getMeshParts(std::vector<MeshPartMessage>& getParts, MeshCapture& capture, MObjectArray& shaders);
+unsigned long long getMeshHash(MeshCapture& capture, std::vector<MeshPartMessage>& parts, SkinBinding* skin);
+void sendMeshTopology(MFnMesh& mesh);
+MObject findSkinCluster(MObject& meshNode);
+SkinBinding* findSkin(MObject& meshNode);
+SkinBinding* bindSkin(MFnMesh& mesh);
+void unbindSkin(MObject& meshNode);
+void getMatrixData(float* getMatrix, const MMatrix& matrix);
+void getJoints(std::vector<JointMessage>& getJoints, SkinMessage& getSkin, SkinBinding& skin);
+void getJointPoses(std::vector<JointPoseMessage>& getPoses, SkinBinding& skin);
+void sendSkin(SkinBinding& skin, MFnMesh& mesh, MeshCapture& capture);
+void sendSkinPose(SkinBinding& skin);
+void markSkinsPosed();
+void timeChanged(MTime& time, void* clientData);
 void getTransformData(TransformMessage& getTransform, MObject& node);
-void getMaterialData(MaterialMessage& getMaterial, MFnMesh& mesh);
-void recursiveTransformUpdate(MFnDagNode& transform);
+void getMaterialData(MaterialMessage& getMaterial, MObject& shaderNode);
+MObject getSurfaceShader(MObject& shadingGroup);
+bool defineMaterial(MObject& shaderNode);
+void defineMaterials(MObjectArray& shaders);
+void sendMaterial(MessageType type, MObject& shaderNode);
+bool isSupportedLight(MObject& node);
+bool getLightData(LightMessage& getLight, MObject& node);
+void sendLight(MessageType type, MObject& node);
+void lightAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* x);
+bool isCameraTransform(MObject& node);
+void registerTransformCallbacks(MObject& node);
+void registerMeshCallbacks(MObject& node);
+void registerLightCallbacks(MObject& node);
+void sendTransformUpdate(MObject& node);
 void nodeAdded(MObject& node, void* clientData);
 void nodeRemoved(MObject& node, void* clientData);
 void nodeRenamed(MObject& node, const MString& oldName, void* clientData);
+void parentAdded(MDagPath& child, MDagPath& parent, void* clientData);
 void meshAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug &plug, MPlug &otherPlug, void* x);
 void matColorAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* x);
 void matAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug &plug, MPlug &otherPlug, void* x);
 void newTextureChange(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* x);
 void newMeshAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* x);
+void sendNewMesh(MFnMesh& mesh, bool shareDuplicate);
 void timerCallback(float elapsedTime, float lastTime, void* clientData);
+void flushChanges(float elapsedTime, float lastTime, void* clientData);
 void topologyChanged(MObject& node, void* clientData);
 void viewportChanged(const MString& str, void* clientData);
+void getCameraData(CameraMessage& getCamera, MDagPath& camPath);
+bool cameraChanged(const CameraMessage& camInfo, const CameraMessage& lastInfo);
+void sendCamera(MDagPath& camPath);
+bool hashChanged(std::unordered_map<std::string, unsigned long long>& hashes, const char* name, unsigned long long hash);
+void renameHash(std::unordered_map<std::string, unsigned long long>& hashes, const char* oldName, const char* newName);
+bool receiveViewerMessages();
+void requestContentHashes();
+void addClipFrame(std::vector<float>& samples, const float* values, size_t channelCount, size_t rotationOffset);
+void bakeClip();
 
 /*
  * Plugin entry point
@@ -65,6 +148,11 @@ EXPORT MStatus initializePlugin(MObject obj) {
 	std::cerr.set_rdbuf(MStreamUtils::stdErrorStream().rdbuf());
 	cout << "Viewer plugin loaded ===========================" << endl;
 
+	unsigned int threadCount = std::thread::hardware_concurrency();
+	g_threadPool = new ThreadPool(threadCount > 1 ? threadCount - 1 : 0); //The main thread works as well
+	g_sender = new AsyncSender(g_comlib, *g_threadPool, SEND_QUEUE_SIZE, SEND_RETRY_LIMIT);
+
+	requestContentHashes(); //Whatever the viewer still has from an earlier session isn't sent again
 	res = registerAllCallbacks(); //Register all callbacks and check if successful
 	res = checkScene(); //Check the scene for already existing meshes
 
@@ -82,6 +170,19 @@ EXPORT MStatus uninitializePlugin(MObject obj) {
 	cout << "Plugin unloaded =========================" << endl;
 
 	MMessage::removeCallbacks(callbackIdArray);
+	callbackIdArray.clear();
+	g_callbacks.clear();
+	g_changes.clear(); //Nothing is left to flush them
+	g_meshHashes.clear();
+	g_materialHashes.clear();
+	g_meshContent.clear();
+	g_panelCameras.clear();
+	g_skins.clear();
+
+	delete g_sender; //Waits until the queued messages are sent
+	g_sender = NULL;
+	delete g_threadPool; //After the sender, it assembles on the pool
+	g_threadPool = NULL;
 
 	return MS::kSuccess;
 }
@@ -91,11 +192,14 @@ MStatus registerAllCallbacks() {
 
 	callbackIdArray.append(MDGMessage::addNodeAddedCallback(nodeAdded, "dependNode", NULL, &status));
 	callbackIdArray.append(MDGMessage::addNodeRemovedCallback(nodeRemoved, "dependNode", NULL, &status));
+	callbackIdArray.append(MDagMessage::addParentAddedCallback(parentAdded, NULL, &status));
 	callbackIdArray.append(MUiMessage::add3dViewPostRenderMsgCallback("modelPanel1", viewportChanged, NULL, &status));
 	callbackIdArray.append(MUiMessage::add3dViewPostRenderMsgCallback("modelPanel2", viewportChanged, NULL, &status));
 	callbackIdArray.append(MUiMessage::add3dViewPostRenderMsgCallback("modelPanel3", viewportChanged, NULL, &status));
 	callbackIdArray.append(MUiMessage::add3dViewPostRenderMsgCallback("modelPanel4", viewportChanged, NULL, &status));
 	callbackIdArray.append(MTimerMessage::addTimerCallback(5.0, timerCallback, NULL, &status));
+	callbackIdArray.append(MTimerMessage::addTimerCallback(1.0f / FLUSH_RATE, flushChanges, NULL, &status));
+	callbackIdArray.append(MDGMessage::addTimeChangeCallback(timeChanged, NULL, &status)); //Animated joints don't trigger any attribute callbacks
 
 	callbackIdArray.append(MNodeMessage::addAttributeChangedCallback(MObject(), newTextureChange, NULL, &status));
 
@@ -105,50 +209,15 @@ MStatus registerAllCallbacks() {
 
 MStatus checkScene() {
 	MStatus status = MS::kSuccess;
-	//Iterate meshes
-	MItDag meshIt(MItDag::kDepthFirst, MFn::kMesh, &status); //Mesh iterator
-	if (status == MS::kSuccess) {
-		while (!meshIt.isDone()) {
-			MFnMesh mesh = meshIt.item(); //Get the mesh from the iterator
-			if (!mesh.isIntermediateObject()) { //Intermediate objects are often temporary and not drawn in the scene
-				newMeshes.push(mesh.object());
-				callbackIdArray.append(MPolyMessage::addPolyTopologyChangedCallback(mesh.object(), topologyChanged, NULL));
-				callbackIdArray.append(MNodeMessage::addNameChangedCallback(mesh.object(), nodeRenamed, NULL, &status));
-				callbackIdArray.append(MNodeMessage::addAttributeChangedCallback(mesh.parent(0), meshAttributeChanged, NULL, &status)); //Transform changes
-				callbackIdArray.append(MNodeMessage::addAttributeChangedCallback(mesh.object(), meshAttributeChanged, NULL, &status)); //Vertex changes
-				callbackIdArray.append(MNodeMessage::addAttributeChangedCallback(mesh.object(), matAttributeChanged, (void*)mesh.name().asChar(), &status));
 
-				//Gather information
-				MessageType type = MESH_ADDED;
-				std::vector<VertexMessage> vertices;
-				getVertexData(vertices, mesh);
-				MeshMessage meshInfo;
-				memcpy(&meshInfo.name, mesh.name().asChar(), NAME_SIZE);
-				meshInfo.vertexCount = vertices.size();
-				TransformMessage transformInfo;
-				getTransformData(transformInfo, mesh.parent(0)); //Send in the parent (shape node)
-				MaterialMessage matInfo;
-				getMaterialData(matInfo, mesh);
-
-				//Create and send message
-				size_t msgSize = sizeof(MessageType) + sizeof(MeshMessage) + (sizeof(VertexMessage) * vertices.size()) + sizeof(TransformMessage) + sizeof(MaterialMessage);
-				void* msg = new char[msgSize];
-
-				memcpy(msg, &type, sizeof(MessageType));
-				memcpy((char*)msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
-				memcpy((char*)msg + sizeof(MessageType) + sizeof(MeshMessage), vertices.data(), (sizeof(VertexMessage) * vertices.size()));
-				memcpy((char*)msg + sizeof(MessageType) + sizeof(MeshMessage) + (sizeof(VertexMessage) * vertices.size()), &transformInfo, sizeof(TransformMessage));
-				memcpy((char*)msg + sizeof(MessageType) + sizeof(MeshMessage) + (sizeof(VertexMessage) * vertices.size()) + sizeof(TransformMessage), &matInfo, sizeof(MaterialMessage));
-				g_comlib.send(msg, msgSize);
-
-				delete msg;
-			}
-			meshIt.next();
-		}
-	}
-	else {
-		cout << "ERROR: Could not create mesh iterator" << endl;
-	}
+	//Everything that already exists in the scene is gathered into contiguous sections and sent in bulk as SCENE_SNAPSHOT messages
+	std::vector<CameraMessage> cameras;
+	std::vector<MaterialMessage> materials;
+	std::vector<TransformMessage> transforms;
+	std::vector<LightMessage> lights;
+	std::vector<MeshMessage> meshes;
+	std::vector<MeshPartMessage> parts;
+	std::vector<VertexMessage> vertices;
 
 	//Iterate cameras
 	MItDag camIt(MItDag::kDepthFirst, MFn::kCamera, &status);
@@ -157,7 +226,6 @@ MStatus checkScene() {
 			MFnCamera camera = camIt.item();
 
 			//Gather information
-			MessageType type = CAMERA_ADDED;
 			CameraMessage camInfo;
 			memcpy(&camInfo.name, camera.name().asChar(), NAME_SIZE);
 			camInfo.type = camera.isOrtho() ? ORTHOGRAPHIC_CAM : PERSPECTIVE_CAM;
@@ -166,21 +234,123 @@ MStatus checkScene() {
 			camInfo.nearPlane = camera.nearClippingPlane();
 			camInfo.FoV = camera.horizontalFieldOfView();
 			camInfo.aspectRatio = camera.aspectRatio();
+			cameras.push_back(camInfo);
 
-			//Create and send message
-			size_t msgSize = sizeof(MessageType) + sizeof(CameraMessage);
-			void* msg = new char[msgSize];
+			camIt.next();
+		}
+	}
 
-			memcpy(msg, &type, sizeof(MessageType));
-			memcpy((char*)msg + sizeof(MessageType), &camInfo, sizeof(camInfo));
-			g_comlib.send(msg, msgSize);
+	//Iterate transforms. Depth first guarantees that a parent is always visited before its children
+	MItDag transformIt(MItDag::kDepthFirst, MFn::kTransform, &status);
+	if (status == MS::kSuccess) {
+		while (!transformIt.isDone()) {
+			MObject transform = transformIt.currentItem();
+			if (!isCameraTransform(transform)) { //Cameras are handled on their own
+				registerTransformCallbacks(transform);
 
-			delete msg;
+				TransformMessage transformInfo;
+				getTransformData(transformInfo, transform);
+				transforms.push_back(transformInfo);
+			}
+			transformIt.next();
+		}
+	}
 
-			camIt.next();
+	//Iterate lights, after the transforms they are attached to
+	MItDag lightIt(MItDag::kDepthFirst, MFn::kLight, &status);
+	if (status == MS::kSuccess) {
+		while (!lightIt.isDone()) {
+			MObject light = lightIt.currentItem();
+			LightMessage lightInfo;
+			if (getLightData(lightInfo, light)) { //Ambient, area and volume lights are not supported
+				registerLightCallbacks(light);
+				lights.push_back(lightInfo);
+			}
+			lightIt.next();
 		}
 	}
 
+	//Iterate meshes
+	MItDag meshIt(MItDag::kDepthFirst, MFn::kMesh, &status); //Mesh iterator
+	if (status == MS::kSuccess) {
+		while (!meshIt.isDone()) {
+			MFnMesh mesh = meshIt.item(); //Get the mesh from the iterator
+			if (!mesh.isIntermediateObject()) { //Intermediate objects are often temporary and not drawn in the scene
+				MObject meshNode = mesh.object();
+				registerMeshCallbacks(meshNode);
+
+				//Gather information
+				SkinBinding* skin = bindSkin(mesh);
+				MeshCapture capture;
+				MObjectArray shaders;
+				captureMesh(capture, mesh, shaders);
+				std::vector<MeshPartMessage> meshParts;
+				getMeshParts(meshParts, capture, shaders);
+				MeshMessage meshInfo;
+				memcpy(&meshInfo.name, mesh.name().asChar(), NAME_SIZE);
+				memcpy(&meshInfo.parentName, MFnDagNode(mesh.parent(0)).name().asChar(), NAME_SIZE);
+				memcpy(&meshInfo.materialName, meshParts[0].materialName, NAME_SIZE);
+				meshInfo.contentHash = getMeshHash(capture, meshParts, skin);
+				if (hashChanged(g_meshHashes, meshInfo.name, meshInfo.contentHash)) { //Otherwise the viewer keeps the vertices it has
+					meshInfo.duplicate = skin == NULL && g_meshContent.count(meshInfo.contentHash) > 0;
+					meshInfo.vertexCount = meshInfo.duplicate ? 0 : capture.getCornerCount();
+					meshInfo.partCount = meshParts.size();
+					if (skin == NULL) {
+						g_meshContent.insert(meshInfo.contentHash);
+					}
+				}
+
+				//A snapshot that grows too big is sent in chunks, since a message has to fit inside the shared buffer
+				if (!meshes.empty() && (vertices.size() + meshInfo.vertexCount) * sizeof(VertexMessage) > SNAPSHOT_CHUNK_SIZE) {
+					sendSceneSnapshot(cameras, materials, transforms, lights, meshes, parts, vertices);
+					cameras.clear();
+					materials.clear();
+					transforms.clear();
+					lights.clear();
+					meshes.clear();
+					parts.clear();
+					vertices.clear();
+				}
+
+				for (unsigned int i = 0; i < shaders.length(); i++) {
+					if (defineMaterial(shaders[i])) { //Only the first mesh using a material adds it to the snapshot
+						MaterialMessage matInfo;
+						getMaterialData(matInfo, shaders[i]);
+						if (hashChanged(g_materialHashes, matInfo.name, matInfo.contentHash)) {
+							materials.push_back(matInfo);
+						}
+					}
+				}
+				meshes.push_back(meshInfo);
+				parts.insert(parts.end(), meshParts.begin(), meshParts.begin() + meshInfo.partCount);
+
+				if (skin != NULL) { //Sent on its own, it reaches the viewer before the snapshot with the mesh
+					if (meshInfo.vertexCount > 0) {
+						sendSkin(*skin, mesh, capture);
+					}
+					else {
+						sendSkinPose(*skin);
+					}
+				}
+
+				//The vertices are assembled straight into the snapshot, split over the thread pool
+				size_t vertexOffset = vertices.size();
+				vertices.resize(vertexOffset + meshInfo.vertexCount);
+				if (meshInfo.vertexCount > 0) {
+					assembleVerticesParallel(capture.getArrays(), vertices.data() + vertexOffset, *g_threadPool);
+				}
+			}
+			meshIt.next();
+		}
+	}
+	else {
+		cout << "ERROR: Could not create mesh iterator" << endl;
+	}
+
+	if (!cameras.empty() || !transforms.empty() || !lights.empty() || !meshes.empty()) {
+		sendSceneSnapshot(cameras, materials, transforms, lights, meshes, parts, vertices);
+	}
+
 	////Iterate materials
 	//MItDependencyNodes matIt(MFn::kLambert, &status); //All material types are derived from lambert
 	//if (status == MS::kSuccess) {
@@ -195,6 +365,43 @@ MStatus checkScene() {
 	return status;
 }
 
+void sendSceneSnapshot(std::vector<CameraMessage>& cameras, std::vector<MaterialMessage>& materials, std::vector<TransformMessage>& transforms, std::vector<LightMessage>& lights, std::vector<MeshMessage>& meshes, std::vector<MeshPartMessage>& parts, std::vector<VertexMessage>& vertices) {
+	MessageType type = SCENE_SNAPSHOT;
+	SceneSnapshotMessage snapshotInfo;
+	snapshotInfo.cameraCount = cameras.size();
+	snapshotInfo.materialCount = materials.size();
+	snapshotInfo.transformCount = transforms.size();
+	snapshotInfo.lightCount = lights.size();
+	snapshotInfo.meshCount = meshes.size();
+	snapshotInfo.partCount = parts.size();
+	snapshotInfo.vertexCount = vertices.size();
+
+	//Create and send message
+	size_t msgSize = sizeof(MessageType) + sizeof(SceneSnapshotMessage) + (sizeof(CameraMessage) * cameras.size()) + (sizeof(MaterialMessage) * materials.size())
+		+ (sizeof(TransformMessage) * transforms.size()) + (sizeof(LightMessage) * lights.size()) + (sizeof(MeshMessage) * meshes.size()) + (sizeof(MeshPartMessage) * parts.size()) + (sizeof(VertexMessage) * vertices.size());
+	char* msg = new char[msgSize];
+	char* section = msg;
+
+	memcpy(section, &type, sizeof(MessageType));
+	section += sizeof(MessageType);
+	memcpy(section, &snapshotInfo, sizeof(SceneSnapshotMessage));
+	section += sizeof(SceneSnapshotMessage);
+	memcpy(section, cameras.data(), sizeof(CameraMessage) * cameras.size());
+	section += sizeof(CameraMessage) * cameras.size();
+	memcpy(section, materials.data(), sizeof(MaterialMessage) * materials.size());
+	section += sizeof(MaterialMessage) * materials.size();
+	memcpy(section, transforms.data(), sizeof(TransformMessage) * transforms.size());
+	section += sizeof(TransformMessage) * transforms.size();
+	memcpy(section, lights.data(), sizeof(LightMessage) * lights.size());
+	section += sizeof(LightMessage) * lights.size();
+	memcpy(section, meshes.data(), sizeof(MeshMessage) * meshes.size());
+	section += sizeof(MeshMessage) * meshes.size();
+	memcpy(section, parts.data(), sizeof(MeshPartMessage) * parts.size());
+	section += sizeof(MeshPartMessage) * parts.size();
+	memcpy(section, vertices.data(), sizeof(VertexMessage) * vertices.size());
+	g_sender->sendOwned(msg, msgSize); //Sent as it is, the sender thread frees it
+}
+
 /*
  * how Maya calls this method when a node is added.
  * new POLY mesh: kPolyXXX, kTransform, kMesh
@@ -212,7 +419,24 @@ void nodeAdded(MObject& node, void* clientData) {
 	if (!node.isNull()) {
 		switch (node.apiType()) {
 		case MFn::kMesh: {
-			meshAddedCallbackID = MNodeMessage::addAttributeChangedCallback(node, newMeshAttributeChanged, NULL); //Create a callback to check for when the object is usable
+			if (!g_callbacks.has(node, CallbackRegistry::PENDING_MESH_CALLBACKS)) { //Check for when the object is usable
+				g_callbacks.add(node, CallbackRegistry::PENDING_MESH_CALLBACKS, MNodeMessage::addAttributeChangedCallback(node, newMeshAttributeChanged, NULL));
+			}
+			break;
+		}
+		case MFn::kTransform:
+		case MFn::kJoint: {
+			registerTransformCallbacks(node); //Camera transforms are filtered when sending since their shape is not parented yet
+			break;
+		}
+		case MFn::kSkinClusterFilter: {
+			g_changes.markDirty(node, ChangeTracker::TOPOLOGY_CHANGE); //Not connected yet, the meshes it deforms are found when flushing
+			break;
+		}
+		case MFn::kPointLight:
+		case MFn::kDirectionalLight:
+		case MFn::kSpotLight: {
+			registerLightCallbacks(node); //The light is sent once it has been parented, see parentAdded
 			break;
 		}
 		}
@@ -226,24 +450,62 @@ void nodeRemoved(MObject& node, void* clientData) {
 		cout << dagNode.name() << " was removed!" << endl;
 		cout << endl;
 
-		void* msg = new char[sizeof(MessageType) + sizeof(MeshMessage)];
+		char msg[sizeof(MessageType) + sizeof(MeshMessage)];
 		MessageType type = MESH_REMOVED;
 		MeshMessage meshInfo;
 		memcpy(&meshInfo.name, dagNode.name().asChar(), NAME_SIZE);
 		meshInfo.vertexCount = mesh.numVertices();
+		g_meshHashes.erase(meshInfo.name);
+		unbindSkin(node); //The viewer drops the skin along with the mesh
 
 		memcpy(msg, &type, sizeof(MessageType));
-		memcpy((char*)msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
-		g_comlib.send(msg, sizeof(MessageType) + sizeof(MeshMessage)); //We can't do sizeof(msg) since it's a void*
-		delete msg;
+		memcpy(msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
+		g_sender->send(msg, sizeof(MessageType) + sizeof(MeshMessage));
 	}
-	else if (node.apiType() == MFn::kPointLight) {
+	else if (node.apiType() == MFn::kTransform) {
+		MFnDagNode dagNode(node);
+		if (!isCameraTransform(node)) {
+			char msg[sizeof(MessageType) + sizeof(TransformMessage)];
+			MessageType type = TRANSFORM_REMOVED;
+			TransformMessage transformInfo;
+			memcpy(&transformInfo.name, dagNode.name().asChar(), NAME_SIZE);
 
+			memcpy(msg, &type, sizeof(MessageType));
+			memcpy(msg + sizeof(MessageType), &transformInfo, sizeof(transformInfo));
+			g_sender->send(msg, sizeof(MessageType) + sizeof(TransformMessage));
+		}
+	}
+	else if (isSupportedLight(node)) {
+		MFnDagNode dagNode(node);
+		char msg[sizeof(MessageType) + sizeof(LightMessage)];
+		MessageType type = LIGHT_REMOVED;
+		LightMessage lightInfo;
+		memcpy(&lightInfo.name, dagNode.name().asChar(), NAME_SIZE);
+
+		memcpy(msg, &type, sizeof(MessageType));
+		memcpy(msg + sizeof(MessageType), &lightInfo, sizeof(lightInfo));
+		g_sender->send(msg, sizeof(MessageType) + sizeof(LightMessage));
+	}
+	else if (node.hasFn(MFn::kSkinClusterFilter)) {
+		for (size_t i = 0; i < g_skins.size(); i++) {
+			if (g_skins[i].skinCluster.object() == node && g_skins[i].mesh.isValid()) { //Sent again in the pose it is left in
+				g_changes.markDirty(g_skins[i].mesh.object(), ChangeTracker::TOPOLOGY_CHANGE);
+			}
+		}
+	}
+	else if (node.hasFn(MFn::kLambert)) {
+		//Sent again if an undo brings it back
+		auto it = std::find(definedMaterials.begin(), definedMaterials.end(), MFnDependencyNode(node).name().asChar());
+		if (it != definedMaterials.end()) {
+			definedMaterials.erase(it);
+		}
 	}
 	//else {
 	//	//cout << "A node was removed!" << endl;
 	//	//cout << endl;
 	//}
+
+	g_callbacks.removeNode(node); //An undo adds the node again and with it new callbacks
 }
 
 void nodeRenamed(MObject& node, const MString& oldName, void* clientData) {
@@ -263,159 +525,515 @@ void nodeRenamed(MObject& node, const MString& oldName, void* clientData) {
 				cout << "DAG Path: " << dagPath.fullPathName() << endl;
 				cout << endl;
 
-				MaterialMessage tempMsg;
-				getMaterialData(tempMsg, mesh); //Temporary, not very great solution
-
-				void* msg = new char[sizeof(MessageType) + sizeof(MeshMessage)];
+				char msg[sizeof(MessageType) + sizeof(MeshMessage)];
 				MessageType type = MESH_RENAMED;
 				MeshMessage meshInfo;
 				memcpy(&meshInfo.oldName, oldName.asChar(), NAME_SIZE);
 				memcpy(&meshInfo.name, dagNodeFn.name().asChar(), NAME_SIZE);
 				meshInfo.vertexCount = mesh.numVertices();
+				renameHash(g_meshHashes, meshInfo.oldName, meshInfo.name);
 
 				memcpy(msg, &type, sizeof(MessageType));
-				memcpy((char*)msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
-				g_comlib.send(msg, sizeof(MessageType) + sizeof(MeshMessage)); //We can't do sizeof(msg) since it's a void*
-				delete msg;
+				memcpy(msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
+				g_sender->send(msg, sizeof(MessageType) + sizeof(MeshMessage));
 			}
 			break;
 		}
+		case MFn::kTransform: {
+			if (!isCameraTransform(node)) {
+				char msg[sizeof(MessageType) + sizeof(TransformMessage)];
+				MessageType type = TRANSFORM_RENAMED;
+				TransformMessage transformInfo;
+				memcpy(&transformInfo.oldName, oldName.asChar(), NAME_SIZE);
+				memcpy(&transformInfo.name, dagNodeFn.name().asChar(), NAME_SIZE);
+
+				memcpy(msg, &type, sizeof(MessageType));
+				memcpy(msg + sizeof(MessageType), &transformInfo, sizeof(transformInfo));
+				g_sender->send(msg, sizeof(MessageType) + sizeof(TransformMessage));
+			}
+			break;
 		}
-	}
-}
+		case MFn::kPointLight:
+		case MFn::kDirectionalLight:
+		case MFn::kSpotLight: {
+			char msg[sizeof(MessageType) + sizeof(LightMessage)];
+			MessageType type = LIGHT_RENAMED;
+			LightMessage lightInfo;
+			memcpy(&lightInfo.oldName, oldName.asChar(), NAME_SIZE);
+			memcpy(&lightInfo.name, dagNodeFn.name().asChar(), NAME_SIZE);
 
-MIntArray getlocalIndex(MIntArray& getVerts, MIntArray& getTri) { //Converts from object-relative index to face-relative index
-	MIntArray localIndex;
-	size_t gv, gt;
-	if (getTri.length() == 3) { //Only handle triangles
-		for (gt = 0; gt < getTri.length(); gt++) {
-			for (gv = 0; gv < getVerts.length(); gv++) {
-				if (getTri[gt] == getVerts[gv]) {
-					localIndex.append(gv);
-					break;
+			memcpy(msg, &type, sizeof(MessageType));
+			memcpy(msg + sizeof(MessageType), &lightInfo, sizeof(lightInfo));
+			g_sender->send(msg, sizeof(MessageType) + sizeof(LightMessage));
+			break;
+		}
+		default: {
+			if (node.hasFn(MFn::kLambert)) { //All material types are derived from lambert
+				MFnDependencyNode shaderDepNode(node);
+				auto it = std::find(definedMaterials.begin(), definedMaterials.end(), oldName.asChar());
+				if (it != definedMaterials.end()) {
+					*it = shaderDepNode.name().asChar();
+
+					char msg[sizeof(MessageType) + sizeof(MaterialMessage)];
+					MessageType type = MATERIAL_RENAMED;
+					MaterialMessage matInfo;
+					memcpy(&matInfo.oldName, oldName.asChar(), NAME_SIZE);
+					memcpy(&matInfo.name, shaderDepNode.name().asChar(), NAME_SIZE);
+					renameHash(g_materialHashes, matInfo.oldName, matInfo.name);
+
+					memcpy(msg, &type, sizeof(MessageType));
+					memcpy(msg + sizeof(MessageType), &matInfo, sizeof(matInfo));
+					g_sender->send(msg, sizeof(MessageType) + sizeof(MaterialMessage));
 				}
 			}
-			// if nothing was added, add default "no match"
-			if (localIndex.length() == gt) {
-				localIndex.append(-1);
-			}
+			break;
+		}
 		}
 	}
-	else {
-		cout << "ERROR in call to getLocalIndex function!" << endl;
+}
+
+void parentAdded(MDagPath& child, MDagPath& parent, void* clientData) {
+	MObject childNode = child.node();
+	if (childNode.apiType() == MFn::kTransform && !isCameraTransform(childNode)) {
+		MObject parentNode = parent.node();
+		if (parentNode.apiType() == MFn::kTransform) {
+			sendTransformUpdate(parentNode); //Make sure a newly created group exists in the viewer before its children are moved into it
+		}
+		sendTransformUpdate(childNode);
+	}
+	else if (isSupportedLight(childNode)) {
+		MObject parentNode = parent.node();
+		if (parentNode.apiType() == MFn::kTransform) {
+			sendTransformUpdate(parentNode); //The light is attached to its transform in the viewer
+		}
+		sendLight(LIGHT_ADDED, childNode);
 	}
+}
 
-	return localIndex;
+void copyIntArray(MIntArray& source, std::vector<int>& destination) {
+	destination.resize(source.length());
+	if (source.length() > 0) {
+		source.get(destination.data());
+	}
 }
 
-void getVertexData(std::vector<VertexMessage>& getVertices, MFnMesh& mesh) {
-	//Gather data from mesh
-	MPointArray pointArray;
-	mesh.getPoints(pointArray);
-	MFloatVectorArray normalArray;
-	mesh.getNormals(normalArray);
-	MStringArray uvSetNames;
-	mesh.getUVSetNames(uvSetNames);
+void captureMesh(MeshCapture& getCapture, MFnMesh& mesh, MObjectArray& getShaders) {
+	//Gather the bulk arrays from the mesh, every triangle corner then maps straight to its face-vertex
+	MIntArray polygonCounts, polygonVertices;
+	mesh.getVertices(polygonCounts, polygonVertices);
+	MIntArray triangleCounts, triangleOffsets;
+	mesh.getTriangleOffsets(triangleCounts, triangleOffsets);
+	MIntArray normalIdCounts, normalIds;
+	mesh.getNormalIds(normalIdCounts, normalIds);
+	MString uvSetName = mesh.currentUVSetName(); //The set the user picked, not just the first one
+	MIntArray uvCounts, uvIds;
+	mesh.getAssignedUVs(uvCounts, uvIds, &uvSetName);
 	MFloatArray uArray;
 	MFloatArray vArray;
-	mesh.getUVs(uArray, vArray, &uvSetNames[0]);
-
-	// Optimization //
-	MIntArray triCount;
-	MIntArray triVerts;
-	mesh.getTriangles(triCount, triVerts);
-	getVertices.resize(triVerts.length()); //Resizing the vector beforehand to avoid pushing back elements
-	size_t counter = 0;
-	//////////////////
-
-	MItMeshPolygon polyIt(mesh.object()); //Iterator
-	for (; !polyIt.isDone(); polyIt.next()) { //Goes through every polygon in the mesh
-		//Points for this polygon
-		MIntArray polyVerts;
-		polyIt.getVertices(polyVerts);
-
-		int triCount;
-		polyIt.numTriangles(triCount); //Triangles in this polygon
-		while (triCount--) { //Becomes false when it becomes negative
-			MPointArray arr;
-			MIntArray localIndex;
-			MIntArray triVerts;
-
-			polyIt.getTriangle(triCount, arr, triVerts);
-			VertexMessage tempVertex[3];
-			for (int i = 0; i < 3; i++) {
-				tempVertex[i].pos[0] = pointArray[triVerts[i]][0];
-				tempVertex[i].pos[1] = pointArray[triVerts[i]][1];
-				tempVertex[i].pos[2] = pointArray[triVerts[i]][2];
+	mesh.getUVs(uArray, vArray, &uvSetName);
+	MObjectArray shadingGroups;
+	MIntArray faceShadingGroups;
+	mesh.getConnectedShaders(0, shadingGroups, faceShadingGroups);
+
+	//Maya arrays can't be read through a pointer, so they are copied once into plain arrays
+	copyIntArray(polygonCounts, getCapture.polygonCounts);
+	copyIntArray(polygonVertices, getCapture.polygonVertices);
+	copyIntArray(triangleCounts, getCapture.triangleCounts);
+	copyIntArray(triangleOffsets, getCapture.triangleOffsets);
+	copyIntArray(normalIds, getCapture.normalIds);
+	copyIntArray(uvCounts, getCapture.uvCounts);
+	copyIntArray(uvIds, getCapture.uvIds);
+	copyIntArray(faceShadingGroups, getCapture.polygonParts);
+	getCapture.us.resize(uArray.length());
+	getCapture.vs.resize(vArray.length());
+	if (!getCapture.us.empty()) {
+		uArray.get(getCapture.us.data());
+		vArray.get(getCapture.vs.data());
+	}
+
+	//The raw arrays belong to the mesh and can change as soon as we return
+	const float* points = mesh.getRawPoints(NULL);
+	const float* normals = mesh.getRawNormals(NULL);
+	getCapture.points.assign(points, points + (size_t)mesh.numVertices() * 3);
+	getCapture.normals.assign(normals, normals + (size_t)mesh.numNormals() * 3);
+
+	//A skinned mesh is sent in its bind pose, which is the geometry going into the skin cluster
+	MObject meshNode = mesh.object();
+	SkinBinding* skin = findSkin(meshNode);
+	if (skin != NULL && skin->skinCluster.isValid()) {
+		MObjectArray inputs;
+		MFnSkinCluster(skin->skinCluster.object()).getInputGeometry(inputs);
+		MStatus status = MS::kSuccess;
+		MFnMesh bindMesh(inputs.length() > 0 ? inputs[0] : MObject(), &status);
+		if (status == MS::kSuccess && bindMesh.numVertices() == mesh.numVertices() && bindMesh.numNormals() == mesh.numNormals()) {
+			MFloatPointArray bindPoints;
+			bindMesh.getPoints(bindPoints);
+			for (unsigned int i = 0; i < bindPoints.length(); i++) {
+				getCapture.points[i * 3] = bindPoints[i].x;
+				getCapture.points[i * 3 + 1] = bindPoints[i].y;
+				getCapture.points[i * 3 + 2] = bindPoints[i].z;
 			}
 
-			localIndex = getlocalIndex(polyVerts, triVerts);
-			// Get UVs for each vertex in the polygon
-			int uvID[3];
-			for (int polyVtx = 0; polyVtx < 3; polyVtx++) {
-				polyIt.getUVIndex(localIndex[polyVtx], uvID[polyVtx], &uvSetNames[0]);
+			MFloatVectorArray bindNormals;
+			bindMesh.getNormals(bindNormals);
+			for (unsigned int i = 0; i < bindNormals.length(); i++) {
+				getCapture.normals[i * 3] = bindNormals[i].x;
+				getCapture.normals[i * 3 + 1] = bindNormals[i].y;
+				getCapture.normals[i * 3 + 2] = bindNormals[i].z;
 			}
+		}
+	}
+
+	//Every shading group becomes a part, faces without one are gathered in a last part without a material
+	getShaders.clear();
+	for (unsigned int i = 0; i < shadingGroups.length(); i++) {
+		getShaders.append(getSurfaceShader(shadingGroups[i]));
+	}
+	getShaders.append(MObject());
+	getCapture.partCount = getShaders.length();
+	if (getCapture.polygonParts.size() != getCapture.polygonCounts.size()) {
+		getCapture.polygonParts.assign(getCapture.polygonCounts.size(), -1);
+	}
+	for (size_t polygon = 0; polygon < getCapture.polygonParts.size(); polygon++) {
+		if (getCapture.polygonParts[polygon] < 0) {
+			getCapture.polygonParts[polygon] = shadingGroups.length();
+		}
+	}
+}
+
+void getMeshParts(std::vector<MeshPartMessage>& getParts, MeshCapture& capture, MObjectArray& shaders) {
+	//Parts without faces are left out, the rest follow each other in the vertices in part order
+	std::vector<size_t> partCorners = countPartCorners(capture.getArrays());
+	size_t firstVertex = 0;
+	getParts.clear();
+	for (size_t part = 0; part < partCorners.size(); part++) {
+		if (partCorners[part] == 0) {
+			continue;
+		}
 
-			for (int i = 0; i < 3; i++) {
-				tempVertex[i].normal[0] = normalArray[polyIt.normalIndex(localIndex[i])][0];
-				tempVertex[i].normal[1] = normalArray[polyIt.normalIndex(localIndex[i])][1];
-				tempVertex[i].normal[2] = normalArray[polyIt.normalIndex(localIndex[i])][2];
+		MeshPartMessage partInfo;
+		if (!shaders[part].isNull()) {
+			memcpy(&partInfo.materialName, MFnDependencyNode(shaders[part]).name().asChar(), NAME_SIZE);
+		}
+		partInfo.firstVertex = firstVertex;
+		partInfo.vertexCount = partCorners[part];
+		getParts.push_back(partInfo);
+		firstVertex += partCorners[part];
+	}
 
-				tempVertex[i].uv[0] = uArray[uvID[i]];
-				tempVertex[i].uv[1] = vArray[uvID[i]];
+	if (getParts.empty()) { //A mesh without faces still gets a part, so the first one always holds the main material
+		getParts.push_back(MeshPartMessage());
+		if (!shaders[0].isNull()) {
+			memcpy(&getParts[0].materialName, MFnDependencyNode(shaders[0]).name().asChar(), NAME_SIZE);
+		}
+	}
+}
+
+unsigned long long getMeshHash(MeshCapture& capture, std::vector<MeshPartMessage>& parts, SkinBinding* skin) {
+	//Assigning another material to some faces changes the parts even when the vertices stay the same
+	unsigned long long hash = capture.getHash();
+	for (size_t i = 0; i < parts.size(); i++) {
+		hash = hashBytes(parts[i].materialName, strnlen(parts[i].materialName, NAME_SIZE), hash);
+		hash = hashBytes(&parts[i].vertexCount, sizeof(parts[i].vertexCount), hash);
+	}
+	if (skin != NULL) { //Binding or unbinding a skin changes what the vertices are sent as
+		hash = hashBytes(&skin->bindHash, sizeof(skin->bindHash), hash);
+	}
+	return hash;
+}
+
+void sendMeshTopology(MFnMesh& mesh) {
+	//Gather information
+	MessageType type = MESH_TOPOLOGY_CHANGED;
+	SkinBinding* skin = bindSkin(mesh);
+	MeshCapture* capture = new MeshCapture;
+	MObjectArray shaders;
+	captureMesh(*capture, mesh, shaders);
+	std::vector<MeshPartMessage> parts;
+	getMeshParts(parts, *capture, shaders);
+	MeshMessage meshInfo;
+	memcpy(&meshInfo.name, mesh.name().asChar(), NAME_SIZE);
+	memcpy(&meshInfo.materialName, parts[0].materialName, NAME_SIZE);
+	meshInfo.vertexCount = capture->getCornerCount();
+	meshInfo.partCount = parts.size();
+	meshInfo.contentHash = getMeshHash(*capture, parts, skin);
+	if (!hashChanged(g_meshHashes, meshInfo.name, meshInfo.contentHash)) { //Attribute sets that don't change the geometry
+		delete capture;
+		return;
+	}
+	defineMaterials(shaders); //Faces can have been assigned a material the viewer hasn't seen yet
+	if (skin != NULL) {
+		sendSkin(*skin, mesh, *capture);
+	}
+
+	//Create and send message, the vertices are left for the sender thread to fill in
+	size_t partsSize = sizeof(MeshPartMessage) * meshInfo.partCount;
+	size_t msgSize = sizeof(MessageType) + sizeof(MeshMessage) + partsSize + (sizeof(VertexMessage) * meshInfo.vertexCount);
+	char* msg = new char[msgSize];
+
+	memcpy(msg, &type, sizeof(MessageType));
+	memcpy(msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
+	memcpy(msg + sizeof(MessageType) + sizeof(MeshMessage), parts.data(), partsSize);
+	g_sender->sendMesh(msg, msgSize, sizeof(MessageType) + sizeof(MeshMessage) + partsSize, capture);
+}
+
+MObject findSkinCluster(MObject& meshNode) {
+	//The skin cluster sits somewhere in the history of the mesh, usually right before it
+	MStatus status = MS::kSuccess;
+	MItDependencyGraph historyIt(meshNode, MFn::kSkinClusterFilter, MItDependencyGraph::kUpstream, MItDependencyGraph::kDepthFirst, MItDependencyGraph::kNodeLevel, &status);
+	if (status != MS::kSuccess || historyIt.isDone()) {
+		return MObject();
+	}
+	return historyIt.currentItem();
+}
+
+SkinBinding* findSkin(MObject& meshNode) {
+	for (size_t i = 0; i < g_skins.size(); i++) {
+		if (g_skins[i].mesh.object() == meshNode) {
+			return &g_skins[i];
+		}
+	}
+	return NULL;
+}
+
+SkinBinding* bindSkin(MFnMesh& mesh) { //Returns NULL when the mesh is sent without a skin
+	MObject meshNode = mesh.object();
+	MObject skinCluster = findSkinCluster(meshNode);
+	MDagPathArray influences;
+	unsigned int influenceCount = 0;
+	if (!skinCluster.isNull()) {
+		influenceCount = MFnSkinCluster(skinCluster).influenceObjects(influences);
+	}
+	if (influenceCount == 0 || influenceCount > MAX_SKIN_JOINTS) {
+		unbindSkin(meshNode);
+		return NULL;
+	}
+
+	SkinBinding* skin = findSkin(meshNode);
+	if (skin == NULL) {
+		g_skins.push_back(SkinBinding());
+		skin = &g_skins.back();
+		skin->mesh = meshNode;
+	}
+	skin->skinCluster = skinCluster;
+
+	//Shallower joints first, so every parent is in place before its children
+	std::vector<int> order(influenceCount);
+	for (unsigned int i = 0; i < influenceCount; i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return influences[a].length() < influences[b].length(); });
+
+	skin->joints.clear();
+	skin->parents.assign(influenceCount, -1);
+	skin->jointIndices.resize(influenceCount);
+	for (unsigned int i = 0; i < influenceCount; i++) {
+		skin->joints.append(influences[order[i]]);
+		skin->jointIndices[order[i]] = i;
+
+		//The closest ancestor in the skin, joints in between that don't influence the mesh are skipped
+		MDagPath ancestor = influences[order[i]];
+		while (skin->parents[i] == -1 && ancestor.length() > 1) {
+			ancestor.pop();
+			for (unsigned int j = 0; j < i; j++) {
+				if (skin->joints[j] == ancestor) {
+					skin->parents[i] = j;
+					break;
+				}
 			}
+		}
+	}
+
+	std::vector<JointMessage> joints;
+	SkinMessage skinInfo;
+	getJoints(joints, skinInfo, *skin);
+	unsigned long long hash = hashBytes(skinInfo.bindShape, sizeof(skinInfo.bindShape));
+	for (size_t i = 0; i < joints.size(); i++) {
+		hash = hashBytes(joints[i].name, strnlen(joints[i].name, NAME_SIZE), hash);
+		hash = hashBytes(&joints[i].parentIndex, sizeof(joints[i].parentIndex), hash);
+		hash = hashBytes(joints[i].inverseBindPose, sizeof(joints[i].inverseBindPose), hash);
+	}
+	skin->bindHash = hash;
+	return skin;
+}
+
+void unbindSkin(MObject& meshNode) {
+	for (size_t i = 0; i < g_skins.size(); i++) {
+		if (g_skins[i].mesh.object() == meshNode) {
+			//A skin without joints tells the viewer to draw the mesh as it is sent
+			MessageType type = SKIN_BOUND;
+			SkinMessage skinInfo;
+			memcpy(&skinInfo.meshName, MFnDependencyNode(meshNode).name().asChar(), NAME_SIZE);
 
-			getVertices[counter] = tempVertex[0];
-			getVertices[counter + 1] = tempVertex[1];
-			getVertices[counter + 2] = tempVertex[2];
+			size_t msgSize = sizeof(MessageType) + sizeof(SkinMessage);
+			char* msg = new char[msgSize];
+			memcpy(msg, &type, sizeof(MessageType));
+			memcpy(msg + sizeof(MessageType), &skinInfo, sizeof(SkinMessage));
+			g_sender->sendOwned(msg, msgSize);
 
-			counter += 3;
+			g_skins.erase(g_skins.begin() + i);
+			return;
 		}
 	}
 }
 
+void getMatrixData(float* getMatrix, const MMatrix& matrix) {
+	for (int row = 0; row < 4; row++) {
+		for (int column = 0; column < 4; column++) {
+			getMatrix[row * 4 + column] = (float)matrix(row, column);
+		}
+	}
+}
+
+void getJoints(std::vector<JointMessage>& getJoints, SkinMessage& getSkin, SkinBinding& skin) {
+	MFnSkinCluster skinCluster(skin.skinCluster.object());
+	MPlug bindPosePlug = skinCluster.findPlug("bindPreMatrix");
+	MObject matrixData;
+
+	memcpy(&getSkin.meshName, MFnDependencyNode(skin.mesh.object()).name().asChar(), NAME_SIZE);
+	getSkin.jointCount = skin.joints.length();
+	skinCluster.findPlug("geomMatrix").getValue(matrixData);
+	getMatrixData(getSkin.bindShape, MFnMatrixData(matrixData).matrix());
+
+	getJoints.resize(skin.joints.length());
+	for (unsigned int i = 0; i < skin.joints.length(); i++) {
+		memcpy(&getJoints[i].name, skin.joints[i].partialPathName().asChar(), NAME_SIZE);
+		getJoints[i].parentIndex = skin.parents[i];
+
+		//The bind pre matrix is the inverse of the joint's world matrix when the skin was bound
+		unsigned int influenceIndex = skinCluster.indexForInfluenceObject(skin.joints[i]);
+		bindPosePlug.elementByLogicalIndex(influenceIndex).getValue(matrixData);
+		getMatrixData(getJoints[i].inverseBindPose, MFnMatrixData(matrixData).matrix());
+	}
+}
+
+void getJointPoses(std::vector<JointPoseMessage>& getPoses, SkinBinding& skin) {
+	//Relative to the parent joint, so the viewer can build the world matrices the same way Maya does
+	getPoses.resize(skin.joints.length());
+	for (unsigned int i = 0; i < skin.joints.length(); i++) {
+		MMatrix pose = skin.joints[i].inclusiveMatrix();
+		if (skin.parents[i] >= 0) {
+			pose = pose * skin.joints[skin.parents[i]].inclusiveMatrixInverse();
+		}
+		getMatrixData(getPoses[i].matrix, pose);
+	}
+}
+
+void sendSkin(SkinBinding& skin, MFnMesh& mesh, MeshCapture& capture) {
+	//Gather information
+	MessageType type = SKIN_BOUND;
+	SkinMessage skinInfo;
+	std::vector<JointMessage> joints;
+	getJoints(joints, skinInfo, skin);
+	std::vector<JointPoseMessage> poses;
+	getJointPoses(poses, skin);
+	skin.poseHash = hashBytes(poses.data(), sizeof(JointPoseMessage) * poses.size());
+
+	//Maya has a weight for every influence, only the strongest four of every point are kept
+	MDagPath meshPath;
+	mesh.getPath(meshPath);
+	MFnSingleIndexedComponent pointComponent;
+	MObject points = pointComponent.create(MFn::kMeshVertComponent);
+	pointComponent.setCompleteData(mesh.numVertices());
+	MDoubleArray weightArray;
+	unsigned int influenceCount = 0;
+	MFnSkinCluster(skin.skinCluster.object()).getWeights(meshPath, points, weightArray, influenceCount);
+
+	std::vector<double> weights(weightArray.length());
+	if (!weights.empty()) {
+		weightArray.get(weights.data());
+	}
+	std::vector<SkinWeightMessage> pointWeights(mesh.numVertices());
+	if (influenceCount == skin.jointIndices.size() && weights.size() == pointWeights.size() * influenceCount) {
+		for (size_t i = 0; i < pointWeights.size(); i++) {
+			pointWeights[i] = reduceInfluences(&weights[i * influenceCount], influenceCount, skin.jointIndices.data());
+		}
+	}
+	skinInfo.vertexCount = capture.getCornerCount();
+
+	//Create and send message, the weights follow the vertices of the mesh one to one
+	size_t jointsSize = sizeof(JointMessage) * joints.size();
+	size_t weightsSize = sizeof(SkinWeightMessage) * skinInfo.vertexCount;
+	size_t posesSize = sizeof(JointPoseMessage) * poses.size();
+	size_t msgSize = sizeof(MessageType) + sizeof(SkinMessage) + jointsSize + weightsSize + posesSize;
+	char* msg = new char[msgSize];
+	char* section = msg;
+
+	memcpy(section, &type, sizeof(MessageType));
+	section += sizeof(MessageType);
+	memcpy(section, &skinInfo, sizeof(SkinMessage));
+	section += sizeof(SkinMessage);
+	memcpy(section, joints.data(), jointsSize);
+	section += jointsSize;
+	std::vector<unsigned int> pointIndices(skinInfo.vertexCount);
+	assemblePointIndices(capture.getArrays(), pointIndices.data());
+	SkinWeightMessage* vertexWeights = (SkinWeightMessage*)section;
+	for (size_t i = 0; i < pointIndices.size(); i++) {
+		vertexWeights[i] = pointWeights[pointIndices[i]];
+	}
+	section += weightsSize;
+	memcpy(section, poses.data(), posesSize);
+	g_sender->sendOwned(msg, msgSize);
+}
+
+void sendSkinPose(SkinBinding& skin) {
+	std::vector<JointPoseMessage> poses;
+	getJointPoses(poses, skin);
+	unsigned long long poseHash = hashBytes(poses.data(), sizeof(JointPoseMessage) * poses.size());
+	if (poseHash == skin.poseHash) { //Every skin is checked when the time changes, most often nothing moved
+		return;
+	}
+	skin.poseHash = poseHash;
+
+	//Gather information
+	MessageType type = SKIN_POSED;
+	SkinMessage skinInfo;
+	memcpy(&skinInfo.meshName, MFnDependencyNode(skin.mesh.object()).name().asChar(), NAME_SIZE);
+	skinInfo.jointCount = poses.size();
+
+	//Create and send message
+	size_t posesSize = sizeof(JointPoseMessage) * poses.size();
+	size_t msgSize = sizeof(MessageType) + sizeof(SkinMessage) + posesSize;
+	char* msg = new char[msgSize];
+
+	memcpy(msg, &type, sizeof(MessageType));
+	memcpy(msg + sizeof(MessageType), &skinInfo, sizeof(SkinMessage));
+	memcpy(msg + sizeof(MessageType) + sizeof(SkinMessage), poses.data(), posesSize);
+	g_sender->sendOwned(msg, msgSize);
+}
+
 void getTransformData(TransformMessage& getTransform, MObject& node) {
 	MFnTransform transform(node);
-	MDagPath dagPath;
-	transform.getPath(dagPath);
-	MMatrix objToWorldMatrix = dagPath.inclusiveMatrix();
-	float matrixValues[4][4];
-	objToWorldMatrix.get(matrixValues);
-
-	getTransform.transformationMatrix[0] = matrixValues[0][0];
-	getTransform.transformationMatrix[1] = matrixValues[0][1];
-	getTransform.transformationMatrix[2] = matrixValues[0][2];
-	getTransform.transformationMatrix[3] = matrixValues[0][3];
-	getTransform.transformationMatrix[4] = matrixValues[1][0];
-	getTransform.transformationMatrix[5] = matrixValues[1][1];
-	getTransform.transformationMatrix[6] = matrixValues[1][2];
-	getTransform.transformationMatrix[7] = matrixValues[1][3];
-	getTransform.transformationMatrix[8] = matrixValues[2][0];
-	getTransform.transformationMatrix[9] = matrixValues[2][1];
-	getTransform.transformationMatrix[10] = matrixValues[2][2];
-	getTransform.transformationMatrix[11] = matrixValues[2][3];
-	getTransform.transformationMatrix[12] = matrixValues[3][0];
-	getTransform.transformationMatrix[13] = matrixValues[3][1];
-	getTransform.transformationMatrix[14] = matrixValues[3][2];
-	getTransform.transformationMatrix[15] = matrixValues[3][3];
-}
-
-void getMaterialData(MaterialMessage& getMaterial, MFnMesh& mesh) {
-	MStatus status = MS::kSuccess;
-	MObjectArray shaders;
-	MIntArray shaderIndices;
-	mesh.getConnectedShaders(0, shaders, shaderIndices);
+	memcpy(&getTransform.name, transform.name().asChar(), NAME_SIZE);
 
-	MFnDependencyNode shadingGroup(shaders[0]);
-	MPlug shaderPlug = shadingGroup.findPlug("surfaceShader");
+	MObject parent = transform.parent(0);
+	if (!parent.hasFn(MFn::kWorld)) { //Transforms directly under the world are placed under the scene root in the viewer
+		memcpy(&getTransform.parentName, MFnDagNode(parent).name().asChar(), NAME_SIZE);
+	}
 
-	MPlugArray shaderConnections;
-	shaderPlug.connectedTo(shaderConnections, true, false);
-	MObject shaderNode = shaderConnections[0].node();
-	MFnDependencyNode shaderDepNode(shaderNode);
+	//Only the local transform is sent, the viewer builds the world matrix from the hierarchy.
+	//The matrix is decomposed here once so the viewer can apply the values directly
+	MTransformationMatrix localMatrix(transform.transformationMatrix());
+	MVector translation = localMatrix.getTranslation(MSpace::kTransform);
+	double rotation[4], scale[3];
+	localMatrix.getRotationQuaternion(rotation[0], rotation[1], rotation[2], rotation[3]);
+	localMatrix.getScale(scale, MSpace::kTransform);
+
+	getTransform.translation[0] = (float)translation.x;
+	getTransform.translation[1] = (float)translation.y;
+	getTransform.translation[2] = (float)translation.z;
+	getTransform.rotation[0] = (float)rotation[0];
+	getTransform.rotation[1] = (float)rotation[1];
+	getTransform.rotation[2] = (float)rotation[2];
+	getTransform.rotation[3] = (float)rotation[3];
+	getTransform.scale[0] = (float)scale[0];
+	getTransform.scale[1] = (float)scale[1];
+	getTransform.scale[2] = (float)scale[2];
+}
 
-	callbackIdArray.append(MNodeMessage::addNameChangedCallback(shaderNode, nodeRenamed, NULL, &status));
-	callbackIdArray.append(MNodeMessage::addAttributeChangedCallback(shaderNode, matColorAttributeChanged, (void*)mesh.name().asChar(), &status));
+void getMaterialData(MaterialMessage& getMaterial, MObject& shaderNode) {
+	MStatus status = MS::kSuccess;
+	MFnDependencyNode shaderDepNode(shaderNode);
 
 	if (shaderNode.hasFn(MFn::kPhong)) {
 		MPlug cosinePowerPlug = shaderDepNode.findPlug("cosinePower");
@@ -445,38 +1063,190 @@ void getMaterialData(MaterialMessage& getMaterial, MFnMesh& mesh) {
 		}
 	}
 
-	memcpy(&getMaterial.name, &shaderDepNode.name(), NAME_SIZE);
+	memcpy(&getMaterial.name, shaderDepNode.name().asChar(), NAME_SIZE);
 	getMaterial.color[0] = r;
 	getMaterial.color[1] = g;
 	getMaterial.color[2] = b;
+
+	unsigned long long hash = hashBytes(getMaterial.color, sizeof(getMaterial.color));
+	hash = hashBytes(getMaterial.diffuseTexPath, strnlen(getMaterial.diffuseTexPath, PATH_SIZE), hash);
+	getMaterial.contentHash = hashBytes(&getMaterial.specularPower, sizeof(getMaterial.specularPower), hash);
 }
 
-void recursiveTransformUpdate(MFnDagNode& transform) {
-	MFnDagNode childNode = transform.child(0);
+MObject getSurfaceShader(MObject& shadingGroup) {
+	MPlug shaderPlug = MFnDependencyNode(shadingGroup).findPlug("surfaceShader");
 
-	MessageType type = MESH_TRANSFORM_CHANGED;
-	MeshMessage meshInfo;
-	memcpy(&meshInfo.name, childNode.name().asChar(), NAME_SIZE);
-	TransformMessage transformInfo;
-	getTransformData(transformInfo, transform.object());
+	MPlugArray shaderConnections;
+	shaderPlug.connectedTo(shaderConnections, true, false);
+	if (shaderConnections.length() == 0) {
+		return MObject();
+	}
+	return shaderConnections[0].node();
+}
+
+bool defineMaterial(MObject& shaderNode) { //Returns true the first time a material is seen, it then has to be sent to the viewer
+	if (shaderNode.isNull()) {
+		return false;
+	}
+
+	MFnDependencyNode shaderDepNode(shaderNode);
+	std::string materialName = shaderDepNode.name().asChar();
+	if (std::find(definedMaterials.begin(), definedMaterials.end(), materialName) != definedMaterials.end()) {
+		return false;
+	}
+	definedMaterials.push_back(materialName);
+
+	//One set of callbacks per material, no matter how many meshes use it
+	if (!g_callbacks.has(shaderNode, CallbackRegistry::MATERIAL_CALLBACKS)) {
+		MStatus status = MS::kSuccess;
+		g_callbacks.add(shaderNode, CallbackRegistry::MATERIAL_CALLBACKS, MNodeMessage::addNameChangedCallback(shaderNode, nodeRenamed, NULL, &status));
+		g_callbacks.add(shaderNode, CallbackRegistry::MATERIAL_CALLBACKS, MNodeMessage::addAttributeChangedCallback(shaderNode, matColorAttributeChanged, NULL, &status));
+	}
+	return true;
+}
+
+void defineMaterials(MObjectArray& shaders) {
+	for (unsigned int i = 0; i < shaders.length(); i++) {
+		if (defineMaterial(shaders[i])) {
+			sendMaterial(MATERIAL_DEFINED, shaders[i]);
+		}
+	}
+}
+
+void sendMaterial(MessageType type, MObject& shaderNode) {
+	MaterialMessage matInfo;
+	getMaterialData(matInfo, shaderNode);
+	if (!hashChanged(g_materialHashes, matInfo.name, matInfo.contentHash)) {
+		return;
+	}
+
+	//Create and send message
+	const size_t msgSize = sizeof(MessageType) + sizeof(MaterialMessage);
+	char msg[msgSize];
+
+	memcpy(msg, &type, sizeof(MessageType));
+	memcpy(msg + sizeof(MessageType), &matInfo, sizeof(matInfo));
+	g_sender->send(msg, msgSize);
+}
+
+bool isSupportedLight(MObject& node) {
+	MFn::Type type = node.apiType();
+	return type == MFn::kPointLight || type == MFn::kDirectionalLight || type == MFn::kSpotLight;
+}
+
+bool getLightData(LightMessage& getLight, MObject& node) {
+	if (!isSupportedLight(node)) {
+		return false;
+	}
+
+	MFnLight light(node);
+	memcpy(&getLight.name, light.name().asChar(), NAME_SIZE);
+	memcpy(&getLight.parentName, MFnDagNode(light.parent(0)).name().asChar(), NAME_SIZE);
+
+	MColor color = light.color();
+	getLight.color[0] = color.r;
+	getLight.color[1] = color.g;
+	getLight.color[2] = color.b;
+	getLight.intensity = light.intensity();
+
+	if (node.apiType() == MFn::kDirectionalLight) {
+		getLight.type = DIRECTIONAL_LIGHT;
+		return true;
+	}
+
+	//Maya lights have no range, so it is taken as the distance where a decaying light becomes too dim to matter
+	short decayRate = MFnNonAmbientLight(node).decayRate();
+	if (decayRate > 0 && getLight.intensity > 0.0f) {
+		getLight.range = pow(getLight.intensity / LIGHT_CUTOFF, 1.0f / decayRate);
+	}
+
+	if (node.apiType() == MFn::kSpotLight) {
+		MFnSpotLight spotLight(node);
+		float coneAngle = (float)spotLight.coneAngle() * 0.5f;
+		float penumbraAngle = (float)spotLight.penumbraAngle(); //Negative penumbras fade inwards
+		getLight.type = SPOT_LIGHT;
+		getLight.innerAngle = penumbraAngle < 0.0f ? coneAngle + penumbraAngle : coneAngle;
+		getLight.outerAngle = penumbraAngle < 0.0f ? coneAngle : coneAngle + penumbraAngle;
+	}
+	else {
+		getLight.type = POINT_LIGHT;
+	}
+	return true;
+}
+
+void sendLight(MessageType type, MObject& node) {
+	LightMessage lightInfo;
+	if (!getLightData(lightInfo, node)) {
+		return;
+	}
 
 	//Create and send message
-	size_t msgSize = sizeof(MessageType) + sizeof(MeshMessage) + sizeof(TransformMessage);
-	void* msg = new char[msgSize];
+	const size_t msgSize = sizeof(MessageType) + sizeof(LightMessage);
+	char msg[msgSize];
 
 	memcpy(msg, &type, sizeof(MessageType));
-	memcpy((char*)msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
-	memcpy((char*)msg + sizeof(MessageType) + sizeof(MeshMessage), &transformInfo, sizeof(TransformMessage));
-	g_comlib.send(msg, msgSize); //We can't do sizeof(msg) since it's a void*
+	memcpy(msg + sizeof(MessageType), &lightInfo, sizeof(lightInfo));
+	g_sender->send(msg, msgSize);
+}
 
-	delete msg;
+void lightAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* x) {
+	if (msg & MNodeMessage::kAttributeSet) {
+		g_changes.markDirty(plug.node(), ChangeTracker::LIGHT_CHANGE);
+	}
+}
 
+bool isCameraTransform(MObject& node) {
+	MFnDagNode transform(node);
 	for (unsigned int i = 0; i < transform.childCount(); i++) {
-		if (transform.child(i).apiType() == MFn::Type::kTransform) {
-			MFnDagNode childNode(transform.child(i));
-			recursiveTransformUpdate(childNode);
+		if (transform.child(i).hasFn(MFn::kCamera)) {
+			return true;
 		}
 	}
+	return false;
+}
+
+void registerTransformCallbacks(MObject& node) {
+	if (g_callbacks.has(node, CallbackRegistry::TRANSFORM_CALLBACKS)) { //Undoing a delete adds the same node again
+		return;
+	}
+	MStatus status = MS::kSuccess;
+	g_callbacks.add(node, CallbackRegistry::TRANSFORM_CALLBACKS, MNodeMessage::addNameChangedCallback(node, nodeRenamed, NULL, &status));
+	g_callbacks.add(node, CallbackRegistry::TRANSFORM_CALLBACKS, MNodeMessage::addAttributeChangedCallback(node, meshAttributeChanged, NULL, &status)); //Transform changes
+}
+
+void registerMeshCallbacks(MObject& node) {
+	if (g_callbacks.has(node, CallbackRegistry::MESH_CALLBACKS)) {
+		return;
+	}
+	MStatus status = MS::kSuccess;
+	g_callbacks.add(node, CallbackRegistry::MESH_CALLBACKS, MPolyMessage::addPolyTopologyChangedCallback(node, topologyChanged, NULL, &status));
+	g_callbacks.add(node, CallbackRegistry::MESH_CALLBACKS, MNodeMessage::addNameChangedCallback(node, nodeRenamed, NULL, &status));
+	g_callbacks.add(node, CallbackRegistry::MESH_CALLBACKS, MNodeMessage::addAttributeChangedCallback(node, meshAttributeChanged, NULL, &status)); //Vertex changes
+	g_callbacks.add(node, CallbackRegistry::MESH_CALLBACKS, MNodeMessage::addAttributeChangedCallback(node, matAttributeChanged, NULL, &status)); //Material changes
+}
+
+void registerLightCallbacks(MObject& node) {
+	if (g_callbacks.has(node, CallbackRegistry::LIGHT_CALLBACKS)) {
+		return;
+	}
+	MStatus status = MS::kSuccess;
+	g_callbacks.add(node, CallbackRegistry::LIGHT_CALLBACKS, MNodeMessage::addNameChangedCallback(node, nodeRenamed, NULL, &status));
+	g_callbacks.add(node, CallbackRegistry::LIGHT_CALLBACKS, MNodeMessage::addAttributeChangedCallback(node, lightAttributeChanged, NULL, &status));
+}
+
+void sendTransformUpdate(MObject& node) {
+	//Only this transform is sent, its children follow along through the node hierarchy in the viewer
+	MessageType type = TRANSFORM_CHANGED;
+	TransformMessage transformInfo;
+	getTransformData(transformInfo, node);
+
+	//Create and send message
+	const size_t msgSize = sizeof(MessageType) + sizeof(TransformMessage);
+	char msg[msgSize];
+
+	memcpy(msg, &type, sizeof(MessageType));
+	memcpy(msg + sizeof(MessageType), &transformInfo, sizeof(TransformMessage));
+	g_sender->send(msg, msgSize);
 }
 
 void newMeshAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* x) {
@@ -484,39 +1254,13 @@ void newMeshAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MP
 		MStatus status = MS::kSuccess;
 		MFnMesh mesh(plug.node(), &status);
 		if (status == MS::kSuccess) {
-			//Push the mesh and add callbacks
-			newMeshes.push(mesh.object());
-			callbackIdArray.append(MPolyMessage::addPolyTopologyChangedCallback(mesh.object(), topologyChanged, NULL));
-			callbackIdArray.append(MNodeMessage::addNameChangedCallback(mesh.object(), nodeRenamed, NULL));
-			callbackIdArray.append(MNodeMessage::addAttributeChangedCallback(mesh.parent(0), meshAttributeChanged, NULL, &status)); //Transform changes
-			callbackIdArray.append(MNodeMessage::addAttributeChangedCallback(mesh.object(), meshAttributeChanged, NULL, &status)); //Vertex changes
-			callbackIdArray.append(MNodeMessage::addAttributeChangedCallback(mesh.object(), matAttributeChanged, (void*)mesh.name().asChar(), &status)); //Material chnages
-
-			MessageType type = MESH_ADDED;
-			std::vector<VertexMessage> vertices;
-			getVertexData(vertices, mesh);
-			MeshMessage meshInfo;
-			memcpy(&meshInfo.name, mesh.name().asChar(), NAME_SIZE);
-			meshInfo.vertexCount = vertices.size();
-			TransformMessage transformInfo;
-			getTransformData(transformInfo, mesh.parent(0));
-			MaterialMessage matInfo;
-			getMaterialData(matInfo, mesh);
-
-			//Create and send message
-			size_t msgSize = sizeof(MessageType) + sizeof(MeshMessage) + (sizeof(VertexMessage) * vertices.size()) + sizeof(TransformMessage) + sizeof(MaterialMessage);
-			void* msg = new char[msgSize];
-
-			memcpy(msg, &type, sizeof(MessageType));
-			memcpy((char*)msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
-			memcpy((char*)msg + sizeof(MessageType) + sizeof(MeshMessage), vertices.data(), (sizeof(VertexMessage) * vertices.size()));
-			memcpy((char*)msg + sizeof(MessageType) + sizeof(MeshMessage) + (sizeof(VertexMessage) * vertices.size()), &transformInfo, sizeof(TransformMessage));
-			memcpy((char*)msg + sizeof(MessageType) + sizeof(MeshMessage) + (sizeof(VertexMessage) * vertices.size()) + sizeof(TransformMessage), &matInfo, sizeof(MaterialMessage));
-			g_comlib.send(msg, msgSize);
+			//Add callbacks
+			MObject meshNode = mesh.object();
+			registerMeshCallbacks(meshNode);
 
-			delete msg;
+			sendNewMesh(mesh, true);
 
-			MMessage::removeCallback(meshAddedCallbackID);
+			g_callbacks.remove(meshNode, CallbackRegistry::PENDING_MESH_CALLBACKS);
 		}
 		//else {
 		//	cout << "Mesh not ready yet." << endl; //Debug
@@ -524,6 +1268,50 @@ void newMeshAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MP
 	}
 }
 
+void sendNewMesh(MFnMesh& mesh, bool shareDuplicate) {
+	MessageType type = MESH_ADDED;
+	SkinBinding* skin = bindSkin(mesh);
+	MeshCapture* capture = new MeshCapture;
+	MObjectArray shaders;
+	captureMesh(*capture, mesh, shaders);
+	defineMaterials(shaders); //The materials have to exist in the viewer before the mesh refers to them
+	std::vector<MeshPartMessage> parts;
+	getMeshParts(parts, *capture, shaders);
+	MeshMessage meshInfo;
+	memcpy(&meshInfo.name, mesh.name().asChar(), NAME_SIZE);
+	memcpy(&meshInfo.parentName, MFnDagNode(mesh.parent(0)).name().asChar(), NAME_SIZE);
+	memcpy(&meshInfo.materialName, parts[0].materialName, NAME_SIZE);
+	meshInfo.partCount = parts.size();
+	meshInfo.contentHash = getMeshHash(*capture, parts, skin);
+	meshInfo.duplicate = shareDuplicate && skin == NULL && g_meshContent.count(meshInfo.contentHash) > 0; //Skinned meshes are never shared
+	meshInfo.vertexCount = meshInfo.duplicate ? 0 : capture->getCornerCount();
+	g_meshHashes[meshInfo.name] = meshInfo.contentHash;
+	if (skin != NULL) {
+		sendSkin(*skin, mesh, *capture);
+	}
+	else {
+		g_meshContent.insert(meshInfo.contentHash);
+	}
+	if (meshInfo.duplicate) { //The viewer already has the vertices
+		delete capture;
+		capture = NULL;
+	}
+	TransformMessage transformInfo;
+	getTransformData(transformInfo, mesh.parent(0)); //The transform the mesh is attached to
+
+	//Create and send message, the vertices are left for the sender thread to fill in
+	size_t partsSize = sizeof(MeshPartMessage) * meshInfo.partCount;
+	size_t vertexOffset = sizeof(MessageType) + sizeof(MeshMessage) + partsSize;
+	size_t msgSize = vertexOffset + (sizeof(VertexMessage) * meshInfo.vertexCount) + sizeof(TransformMessage);
+	char* msg = new char[msgSize];
+
+	memcpy(msg, &type, sizeof(MessageType));
+	memcpy(msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
+	memcpy(msg + sizeof(MessageType) + sizeof(MeshMessage), parts.data(), partsSize);
+	memcpy(msg + vertexOffset + (sizeof(VertexMessage) * meshInfo.vertexCount), &transformInfo, sizeof(TransformMessage));
+	g_sender->sendMesh(msg, msgSize, vertexOffset, capture);
+}
+
 void meshAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug &plug, MPlug &otherPlug, void* x) {
 	if (plug.node().apiType() == MFn::kMesh) {
 		if (msg & MNodeMessage::kAttributeSet) {
@@ -536,37 +1324,20 @@ void meshAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug &plug, MPlug
 
 				unsigned int index = plug.logicalIndex();
 				if (index != -1) {
-					MFnMesh mesh(plug.node());
-					MPoint pnt;
-					mesh.getPoint(index, pnt);
-
-					//Gather information
-					MessageType type = MESH_TOPOLOGY_CHANGED;
-					std::vector<VertexMessage> vertices;
-					getVertexData(vertices, mesh);
-					MeshMessage meshInfo;
-					memcpy(&meshInfo.name, mesh.name().asChar(), NAME_SIZE);
-					meshInfo.vertexCount = vertices.size();
-
-					//Create and send message
-					size_t msgSize = sizeof(MessageType) + sizeof(MeshMessage) + (sizeof(VertexMessage) * vertices.size());
-					void* msg = new char[msgSize];
-
-					memcpy(msg, &type, sizeof(MessageType));
-					memcpy((char*)msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
-					memcpy((char*)msg + sizeof(MessageType) + sizeof(MeshMessage), vertices.data(), (sizeof(VertexMessage) * vertices.size()));
-					g_comlib.send(msg, msgSize);
-
-					delete msg;
+					g_changes.markDirty(plug.node(), ChangeTracker::POINTS_CHANGE);
 				}
 			}
 		}
 	}
 
-	if (plug.node().apiType() == MFn::kTransform) {
-		MFnDagNode parentNode(plug.node());
-
-		recursiveTransformUpdate(parentNode);
+	if (plug.node().hasFn(MFn::kTransform)) {
+		MObject transform = plug.node();
+		if (!isCameraTransform(transform)) {
+			g_changes.markDirty(transform, ChangeTracker::TRANSFORM_CHANGE);
+		}
+		if (transform.hasFn(MFn::kJoint)) { //Posing by hand, the skins sort out if their joints moved
+			markSkinsPosed();
+		}
 
 		//cout << "The transform node " << plug.name() << " has changed!" << endl;
 		//cout << endl;
@@ -574,137 +1345,23 @@ void meshAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug &plug, MPlug
 }
 
 void matAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug &plug, MPlug &otherPlug, void* x) {
-	if (msg & MNodeMessage::kConnectionMade) { //This could be improved
-		MStatus status = MS::kSuccess;
-
-		MObjectArray shaders;
-		MIntArray shaderIndices;
-		MFnMesh mesh(plug.node());
-		mesh.getConnectedShaders(0, shaders, shaderIndices);
-
-		MFnDependencyNode shadingGroup(shaders[0]);
-		MPlug shaderPlug = shadingGroup.findPlug("surfaceShader");
-
-		MPlugArray shaderConnections;
-		shaderPlug.connectedTo(shaderConnections, true, false);
-		MObject shaderNode = shaderConnections[0].node();
-		MFnDependencyNode shaderDepNode(shaderNode);
-
-		callbackIdArray.append(MNodeMessage::addAttributeChangedCallback(shaderNode, matColorAttributeChanged, (void*)mesh.name().asChar(), &status));
-
-		//Gather information
-		MessageType type = MATERIAL_CHANGED;
-		MeshMessage meshInfo;
-		memcpy(&meshInfo.name, mesh.name().asChar(), NAME_SIZE);
-		MaterialMessage matInfo;
-
-		if (shaderNode.hasFn(MFn::kPhong)) {
-			MPlug cosinePowerPlug = shaderDepNode.findPlug("cosinePower");
-			cosinePowerPlug.getValue(matInfo.specularPower);
-		}
-
-		MPlug colorPlug = shaderDepNode.findPlug("color");
-		MObject colorData;
-		colorPlug.getValue(colorData);
-		MFnNumericData colorValues(colorData);
-		float r, g, b;
-		colorValues.getData(r, g, b);
-
-		MPlugArray colorPlugArr;
-		colorPlug.connectedTo(colorPlugArr, true, false);
-		if (colorPlugArr.length() > 0) {
-			MObject texPathNode(colorPlugArr[0].node());
-			MPlug texPathPlug = MFnDependencyNode(texPathNode).findPlug("fileTextureName", &status);
-			if (status == MS::kSuccess) {
-				MString textureName;
-				texPathPlug.getValue(textureName);
-
-				memcpy(&matInfo.diffuseTexPath, textureName.asChar(), NAME_SIZE);
-
-				//cout << textureName << endl; //Debug
-			}
-		}
-
-		memcpy(&matInfo.name, &shaderDepNode.name(), NAME_SIZE);
-		matInfo.color[0] = r;
-		matInfo.color[1] = g;
-		matInfo.color[2] = b;
-
-		//Create and send message
-		size_t msgSize = sizeof(MessageType) + sizeof(MeshMessage) + sizeof(MaterialMessage);
-		void* msg = new char[msgSize];
-
-		memcpy(msg, &type, sizeof(MessageType));
-		memcpy((char*)msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
-		memcpy((char*)msg + sizeof(MessageType) + sizeof(MeshMessage), &matInfo, sizeof(matInfo));
-		g_comlib.send(msg, msgSize);
-
-		delete msg;
+	if (msg & (MNodeMessage::kConnectionMade | MNodeMessage::kConnectionBroken)) { //Face sets move between shading groups
+		//The faces of the mesh are regrouped by material, which is sent along with the vertices
+		g_changes.markDirty(plug.node(), ChangeTracker::TOPOLOGY_CHANGE);
 
 		//cout << "connection made for: " << plug.name() << ",  " << plug.partialName() << endl; //Debug
 	}
 }
 
 void matColorAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* x) {
-	if (msg & MNodeMessage::kAttributeSet) {
-		MFnDependencyNode shaderDepNode(plug.node());
-		MStatus status = MS::kSuccess;
-
-		//Gather information
-		MessageType type = MATERIAL_CHANGED;
-		MeshMessage meshInfo;
-		memcpy(&meshInfo.name, (char*)x, NAME_SIZE);
-		MaterialMessage matInfo;
-
-		if (plug.node().hasFn(MFn::kPhong)) {
-			MPlug cosinePowerPlug = shaderDepNode.findPlug("cosinePower");
-			cosinePowerPlug.getValue(matInfo.specularPower);
-		}
-
-		MPlug colorPlug = shaderDepNode.findPlug("color");
-		MObject colorData;
-		colorPlug.getValue(colorData);
-		MFnNumericData colorValues(colorData);
-		float r, g, b;
-		colorValues.getData(r, g, b);
-
-		MPlugArray colorPlugArr;
-		colorPlug.connectedTo(colorPlugArr, true, false);
-		if (colorPlugArr.length() > 0) {
-			MObject texPathNode(colorPlugArr[0].node());
-			MPlug texPathPlug = MFnDependencyNode(texPathNode).findPlug("fileTextureName", &status);
-			if (status == MS::kSuccess) {
-				MString textureName;
-				texPathPlug.getValue(textureName);
-
-				memcpy(&matInfo.diffuseTexPath, textureName.asChar(), NAME_SIZE);
-
-				//cout << "Inside matColorAttributeChanged " << textureName << endl; //Debug
-			}
-		}
+	if (msg & (MNodeMessage::kAttributeSet | MNodeMessage::kConnectionMade | MNodeMessage::kConnectionBroken)) { //Connections cover textures being added or removed
+		g_changes.markDirty(plug.node(), ChangeTracker::MATERIAL_CHANGE); //One message no matter how many meshes use the material
 
-		memcpy(&matInfo.name, &shaderDepNode.name(), NAME_SIZE);
-		matInfo.color[0] = r;
-		matInfo.color[1] = g;
-		matInfo.color[2] = b;
-
-		//Create and send message
-		size_t msgSize = sizeof(MessageType) + sizeof(MeshMessage) + sizeof(MaterialMessage);
-		void* msg = new char[msgSize];
-
-		memcpy(msg, &type, sizeof(MessageType));
-		memcpy((char*)msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
-		memcpy((char*)msg + sizeof(MessageType) + sizeof(MeshMessage), &matInfo, sizeof(matInfo));
-		g_comlib.send(msg, msgSize);
-
-		delete msg;
-
-		//cout << "Material changed for mesh: " << meshInfo.name << endl; //Debug
+		//cout << "Material changed: " << MFnDependencyNode(shaderNode).name() << endl; //Debug
 	}
 }
 
 void newTextureChange(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* x) {
-	MStatus status = MS::kSuccess;
 	if (msg & MNodeMessage::kAttributeSet) {
 		if (plug.node().apiType() == MFn::kFileTexture) {
 			if (!plug.node().isNull()) {
@@ -715,89 +1372,13 @@ void newTextureChange(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& ot
 				depNode.getConnections(plugArray);
 
 				for (int i = 0; i < plugArray.length(); i++) {
-					//cout << plugArray[i].name() << endl; //Debug
-					MString textureName;
-
 					MPlugArray connections;
-					plugArray[i].connectedTo(connections, true, true);
+					plugArray[i].connectedTo(connections, false, true);
 
-					MObject shaderNode = connections[0].node();
-					MFnLambertShader lambertShader(shaderNode);
-
-					//cout << "Lambert shader name: " << lambertShader.name() << endl; //Debug
-
-					float specularPower = 0.0f;
-
-					if (shaderNode.hasFn(MFn::kPhong)) {
-						MPlug cosinePowerPlug = lambertShader.findPlug("cosinePower");
-						cosinePowerPlug.getValue(specularPower);
-					}
-
-					MPlug colorPlug = lambertShader.findPlug("color", &status);
-
-					MPlugArray colorConnections;
-					colorPlug.connectedTo(colorConnections, true, false);
-					if (colorConnections.length() > 0) {
-						MObject texPathNode(colorConnections[0].node());
-						MPlug texPathPlug = MFnDependencyNode(texPathNode).findPlug("fileTextureName", &status);
-						if (status == MS::kSuccess) {
-							texPathPlug.getValue(textureName);
-
-							//cout << "Texture name: " << textureName << endl; //Debug
-						}
-					}
-
-					MPlugArray lambertPlugs;
-					lambertShader.getConnections(lambertPlugs);
-
-					if (lambertPlugs.length() > 1) {
-						MPlug outColorPlug(lambertPlugs[1]); //OutColor
-						//cout << "OutColorPlug name: " << outColorPlug.name() << ", " << plug.partialName() << endl; //Debug
-						MPlugArray outColorPlugs;
-						outColorPlug.connectedTo(outColorPlugs, true, true);
-
-						MFnDependencyNode matInfoNode(outColorPlugs[0].node());
-						MPlugArray matInfoPlugs;
-						matInfoNode.getConnections(matInfoPlugs);
-
-						for (int j = 0; j < matInfoPlugs.length(); j++) {
-							MFnAttribute myAttr = matInfoPlugs[j].attribute();
-							MString attributeName = myAttr.name();
-							//cout << "Attribute name: " << attributeName << endl; //Debug
-							if (attributeName == "dagSetMembers") {
-								MPlug memberPlug = matInfoPlugs[j];
-								MPlugArray memberPlugs;
-								memberPlug.connectedTo(memberPlugs, true, true);
-								for (int k = 0; k < memberPlugs.length(); k++) {
-									MFnMesh mesh(memberPlugs[k].node(), &status);
-									if (status == MS::kSuccess) {
-										//cout << "Mesh name: " << mesh.name() << endl; //Debug
-
-										MessageType type = MATERIAL_CHANGED;
-										MeshMessage meshInfo;
-										memcpy(&meshInfo.name, mesh.name().asChar(), NAME_SIZE);
-										MaterialMessage matInfo;
-										memcpy(&matInfo.diffuseTexPath, textureName.asChar(), NAME_SIZE);
-
-										matInfo.color[0] = 1.0f;
-										matInfo.color[1] = 1.0f;
-										matInfo.color[2] = 1.0f;
-
-										matInfo.specularPower = specularPower;
-
-										//Create and send message
-										size_t msgSize = sizeof(MessageType) + sizeof(MeshMessage) + sizeof(MaterialMessage);
-										void* msg = new char[msgSize];
-
-										memcpy(msg, &type, sizeof(MessageType));
-										memcpy((char*)msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
-										memcpy((char*)msg + sizeof(MessageType) + sizeof(MeshMessage), &matInfo, sizeof(matInfo));
-										g_comlib.send(msg, msgSize);
-
-										delete msg;
-									}
-								}
-							}
+					for (int j = 0; j < connections.length(); j++) {
+						MObject shaderNode = connections[j].node();
+						if (shaderNode.hasFn(MFn::kLambert)) { //Update the material using the texture, not every mesh using the material
+							g_changes.markDirty(shaderNode, ChangeTracker::MATERIAL_CHANGE);
 						}
 					}
 				}
@@ -809,10 +1390,92 @@ void newTextureChange(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& ot
 
 void timerCallback(float elapsedTime, float lastTime, void* clientData) {
 	timeElapsed += elapsedTime;
+
+	if (g_callbacks.getCallbackCount() != g_reportedCallbackCount) {
+		cout << "Callbacks: " << g_callbacks.getCallbackCount() << " on " << g_callbacks.getNodeCount() << " nodes" << endl;
+		g_reportedCallbackCount = g_callbacks.getCallbackCount();
+	}
+
+	//Only report when messages were dropped or callbacks had to wait for the sender
+	AsyncSender::Statistics statistics = g_sender->getStatistics();
+	if (statistics.dropped != g_reportedStatistics.dropped || statistics.stalls != g_reportedStatistics.stalls) {
+		cout << "Sender: " << statistics.messagesSent << " messages (" << statistics.bytesSent << " bytes) sent, "
+			<< statistics.dropped << " dropped, " << statistics.retries << " retries, "
+			<< statistics.stalls << " stalls, " << statistics.peakQueued << " peak queued" << endl;
+		if (statistics.dropped != g_reportedStatistics.dropped) {
+			cout << "ERROR: Messages could not be sent, is the viewer running?" << endl;
+		}
+		g_reportedStatistics = statistics;
+	}
 	//cout << "Elapsed time: " << timeElapsed << " seconds" << endl;
 	//cout << endl;
 }
 
+void flushChanges(float elapsedTime, float lastTime, void* clientData) {
+	receiveViewerMessages(); //Content hashes when the viewer starts or is asked, clip requests
+
+	if (g_changes.isEmpty()) {
+		return;
+	}
+
+	static std::vector<ChangeTracker::Change> changes; //Reused so flushing doesn't allocate every time
+	g_changes.takeChanges(changes);
+
+	//However many callbacks fired, every node is extracted once
+	for (size_t i = 0; i < changes.size(); i++) {
+		if (!changes[i].node.isValid()) { //Deleted since it was marked
+			continue;
+		}
+
+		MObject node = changes[i].node.object();
+		unsigned int kinds = changes[i].kinds;
+		if (kinds & ChangeTracker::TRANSFORM_CHANGE) {
+			sendTransformUpdate(node);
+		}
+		if (kinds & (ChangeTracker::POINTS_CHANGE | ChangeTracker::TOPOLOGY_CHANGE)) { //Both need every vertex resent
+			if (node.hasFn(MFn::kSkinClusterFilter)) { //A new skin, the meshes it deforms are sent again in their bind pose
+				MObjectArray outputs;
+				MFnSkinCluster(node).getOutputGeometry(outputs);
+				for (unsigned int j = 0; j < outputs.length(); j++) {
+					if (outputs[j].hasFn(MFn::kMesh)) {
+						MFnMesh mesh(outputs[j]);
+						sendMeshTopology(mesh);
+					}
+				}
+			}
+			else {
+				MFnMesh mesh(node);
+				sendMeshTopology(mesh);
+			}
+		}
+		if (kinds & ChangeTracker::POSE_CHANGE) {
+			SkinBinding* skin = findSkin(node);
+			if (skin != NULL) {
+				sendSkinPose(*skin);
+			}
+		}
+		if (kinds & ChangeTracker::MATERIAL_CHANGE) {
+			sendMaterial(MATERIAL_UPDATED, node);
+		}
+		if (kinds & ChangeTracker::LIGHT_CHANGE) {
+			sendLight(LIGHT_CHANGED, node);
+		}
+		if (kinds & ChangeTracker::CAMERA_CHANGE) {
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (CAMERA_RATE > 0.0f && std::chrono::duration<float>(now - g_lastCameraSend).count() < 1.0f / CAMERA_RATE) {
+				g_changes.markDirty(node, ChangeTracker::CAMERA_CHANGE); //Too soon, left for a later flush
+				continue;
+			}
+
+			MDagPath camPath;
+			if (MDagPath::getAPathTo(node, camPath) == MS::kSuccess) {
+				sendCamera(camPath);
+				g_lastCameraSend = now;
+			}
+		}
+	}
+}
+
 void topologyChanged(MObject& node, void* clientData) {
 	if (!node.isNull()) {
 		MStatus status = MS::kSuccess;
@@ -822,77 +1485,389 @@ void topologyChanged(MObject& node, void* clientData) {
 		//cout << "Topology has chaged!" << endl; //Debug
 		//cout << "DAG Path: " << mesh.fullPathName() << endl; //Debug
 
-		//Gather information
-		MessageType type = MESH_TOPOLOGY_CHANGED;
-		std::vector<VertexMessage> vertices;
-		getVertexData(vertices, mesh);
-		MeshMessage meshInfo;
-		memcpy(&meshInfo.name, mesh.name().asChar(), NAME_SIZE);
-		meshInfo.vertexCount = vertices.size();
-
-		//Create and send message
-		size_t msgSize = sizeof(MessageType) + sizeof(MeshMessage) + (sizeof(VertexMessage) * vertices.size());
-		void* msg = new char[msgSize];
-
-		memcpy(msg, &type, sizeof(MessageType));
-		memcpy((char*)msg + sizeof(MessageType), &meshInfo, sizeof(meshInfo));
-		memcpy((char*)msg + sizeof(MessageType) + sizeof(MeshMessage), vertices.data(), (sizeof(VertexMessage) * vertices.size()));
-		g_comlib.send(msg, msgSize);
+		g_changes.markDirty(node, ChangeTracker::TOPOLOGY_CHANGE);
+	}
+}
 
-		delete msg;
+void markSkinsPosed() {
+	for (size_t i = 0; i < g_skins.size(); i++) {
+		if (g_skins[i].mesh.isValid()) {
+			g_changes.markDirty(g_skins[i].mesh.object(), ChangeTracker::POSE_CHANGE);
+		}
 	}
 }
 
+void timeChanged(MTime& time, void* clientData) {
+	markSkinsPosed(); //Playing or scrubbing, only the joint poses are sent
+}
+
 void viewportChanged(const MString& panelName, void* clientData) {
 	MStatus status;
 	M3dView view;
 	status = M3dView::getM3dViewFromModelPanel(panelName, view);
 
 	if (status == MS::kSuccess) {
+		if (view.widget() != M3dView::active3dView().widget()) { //Every panel redraws, only the one being worked in is followed
+			return;
+		}
+
 		MDagPath camPath;
 		view.getCamera(camPath);
-		MFnCamera camera(camPath);
-		MMatrix camPos = camPath.inclusiveMatrix();
-
-		//Gather information
-		MessageType type = VIEW_CHANGED;
 		CameraMessage camInfo;
-		memcpy(&camInfo.name, camera.name().asChar(), NAME_SIZE);
-		camInfo.type = camera.isOrtho(&status) ? ORTHOGRAPHIC_CAM : PERSPECTIVE_CAM;
-		camInfo.viewWidth = camera.orthoWidth();
-		camInfo.farPlane = camera.farClippingPlane();
-		camInfo.nearPlane = camera.nearClippingPlane();
-		camInfo.FoV = camera.horizontalFieldOfView();
-		camInfo.aspectRatio = camera.aspectRatio();
-
-		float matrixValues[4][4];
-		camPos.get(matrixValues);
-
-		camInfo.transformationMatrix[0] = matrixValues[0][0];
-		camInfo.transformationMatrix[1] = matrixValues[0][1];
-		camInfo.transformationMatrix[2] = matrixValues[0][2];
-		camInfo.transformationMatrix[3] = matrixValues[0][3];
-		camInfo.transformationMatrix[4] = matrixValues[1][0];
-		camInfo.transformationMatrix[5] = matrixValues[1][1];
-		camInfo.transformationMatrix[6] = matrixValues[1][2];
-		camInfo.transformationMatrix[7] = matrixValues[1][3];
-		camInfo.transformationMatrix[8] = matrixValues[2][0];
-		camInfo.transformationMatrix[9] = matrixValues[2][1];
-		camInfo.transformationMatrix[10] = matrixValues[2][2];
-		camInfo.transformationMatrix[11] = matrixValues[2][3];
-		camInfo.transformationMatrix[12] = matrixValues[3][0];
-		camInfo.transformationMatrix[13] = matrixValues[3][1];
-		camInfo.transformationMatrix[14] = matrixValues[3][2];
-		camInfo.transformationMatrix[15] = matrixValues[3][3];
-
-		//Create and send message
-		size_t msgSize = sizeof(MessageType) + sizeof(CameraMessage);
-		void* msg = new char[msgSize];
+		getCameraData(camInfo, camPath);
 
-		memcpy(msg, &type, sizeof(MessageType));
-		memcpy((char*)msg + sizeof(MessageType), &camInfo, sizeof(camInfo));
-		g_comlib.send(msg, msgSize);
+		//Redraws happen all the time without the camera moving
+		auto it = g_panelCameras.find(panelName.asChar());
+		if (it != g_panelCameras.end() && !cameraChanged(camInfo, it->second)) {
+			return;
+		}
+		g_panelCameras[panelName.asChar()] = camInfo;
+		g_changes.markDirty(camPath.node(), ChangeTracker::CAMERA_CHANGE); //Sent by the next flush, not on every redraw
+	}
+}
 
-		delete msg;
+void getCameraData(CameraMessage& getCamera, MDagPath& camPath) {
+	MStatus status;
+	MFnCamera camera(camPath);
+	MMatrix camPos = camPath.inclusiveMatrix();
+
+	memcpy(&getCamera.name, camera.name().asChar(), NAME_SIZE);
+	getCamera.type = camera.isOrtho(&status) ? ORTHOGRAPHIC_CAM : PERSPECTIVE_CAM;
+	getCamera.viewWidth = camera.orthoWidth();
+	getCamera.farPlane = camera.farClippingPlane();
+	getCamera.nearPlane = camera.nearClippingPlane();
+	getCamera.FoV = camera.horizontalFieldOfView();
+	getCamera.aspectRatio = camera.aspectRatio();
+
+	float matrixValues[4][4];
+	camPos.get(matrixValues);
+
+	getCamera.transformationMatrix[0] = matrixValues[0][0];
+	getCamera.transformationMatrix[1] = matrixValues[0][1];
+	getCamera.transformationMatrix[2] = matrixValues[0][2];
+	getCamera.transformationMatrix[3] = matrixValues[0][3];
+	getCamera.transformationMatrix[4] = matrixValues[1][0];
+	getCamera.transformationMatrix[5] = matrixValues[1][1];
+	getCamera.transformationMatrix[6] = matrixValues[1][2];
+	getCamera.transformationMatrix[7] = matrixValues[1][3];
+	getCamera.transformationMatrix[8] = matrixValues[2][0];
+	getCamera.transformationMatrix[9] = matrixValues[2][1];
+	getCamera.transformationMatrix[10] = matrixValues[2][2];
+	getCamera.transformationMatrix[11] = matrixValues[2][3];
+	getCamera.transformationMatrix[12] = matrixValues[3][0];
+	getCamera.transformationMatrix[13] = matrixValues[3][1];
+	getCamera.transformationMatrix[14] = matrixValues[3][2];
+	getCamera.transformationMatrix[15] = matrixValues[3][3];
+}
+
+bool cameraChanged(const CameraMessage& camInfo, const CameraMessage& lastInfo) {
+	if (camInfo.type != lastInfo.type || strcmp(camInfo.name, lastInfo.name) != 0) {
+		return true;
+	}
+	for (int i = 0; i < 16; i++) {
+		if (fabsf(camInfo.transformationMatrix[i] - lastInfo.transformationMatrix[i]) > CAMERA_EPSILON) {
+			return true;
+		}
+	}
+	return fabsf(camInfo.FoV - lastInfo.FoV) > CAMERA_EPSILON || fabsf(camInfo.aspectRatio - lastInfo.aspectRatio) > CAMERA_EPSILON
+		|| fabsf(camInfo.farPlane - lastInfo.farPlane) > CAMERA_EPSILON || fabsf(camInfo.nearPlane - lastInfo.nearPlane) > CAMERA_EPSILON
+		|| fabsf(camInfo.viewWidth - lastInfo.viewWidth) > CAMERA_EPSILON;
+}
+
+void sendCamera(MDagPath& camPath) {
+	MessageType type = VIEW_CHANGED;
+	CameraMessage camInfo;
+	getCameraData(camInfo, camPath);
+
+	//Create and send message
+	const size_t msgSize = sizeof(MessageType) + sizeof(CameraMessage);
+	char msg[msgSize];
+
+	memcpy(msg, &type, sizeof(MessageType));
+	memcpy(msg + sizeof(MessageType), &camInfo, sizeof(camInfo));
+	g_sender->send(msg, msgSize);
+}
+
+bool hashChanged(std::unordered_map<std::string, unsigned long long>& hashes, const char* name, unsigned long long hash) { //Remembers the new hash
+	auto it = hashes.find(name);
+	if (it != hashes.end() && it->second == hash) {
+		return false;
+	}
+	hashes[name] = hash;
+	return true;
+}
+
+void renameHash(std::unordered_map<std::string, unsigned long long>& hashes, const char* oldName, const char* newName) {
+	auto it = hashes.find(oldName);
+	if (it != hashes.end()) {
+		unsigned long long hash = it->second;
+		hashes.erase(it);
+		hashes[newName] = hash;
+	}
+}
+
+bool receiveViewerMessages() { //Returns true when the viewer listed its content
+	bool received = false;
+	size_t msgSize = g_viewerComlib.nextSize();
+	while (msgSize > 0) {
+		char* msg = new char[msgSize];
+		if (g_viewerComlib.recv(msg, msgSize) == true) {
+			MessageType type = *(MessageType*)msg;
+			if (type == CONTENT_HASHES) {
+				ContentHashesMessage* hashesInfo = (ContentHashesMessage*)(msg + sizeof(MessageType));
+				ContentHashMessage* meshHashes = (ContentHashMessage*)(msg + sizeof(MessageType) + sizeof(ContentHashesMessage));
+				ContentHashMessage* materialHashes = meshHashes + hashesInfo->meshCount;
+
+				//Replaces what we had, a viewer that was restarted has nothing
+				g_meshHashes.clear();
+				for (size_t i = 0; i < hashesInfo->meshCount; i++) {
+					g_meshHashes[meshHashes[i].name] = meshHashes[i].contentHash;
+				}
+				g_materialHashes.clear();
+				for (size_t i = 0; i < hashesInfo->materialCount; i++) {
+					g_materialHashes[materialHashes[i].name] = materialHashes[i].contentHash;
+				}
+				g_meshContent.clear();
+				for (auto& it : g_meshHashes) { //The viewer asks again for any it can't share
+					g_meshContent.insert(it.second);
+				}
+				received = true;
+			}
+			else if (type == CLIP_REQUESTED) {
+				bakeClip();
+			}
+			else if (type == MESH_REQUESTED) {
+				//The mesh a duplicate was sent against has since been edited or removed in the viewer
+				MeshMessage* meshInfo = (MeshMessage*)(msg + sizeof(MessageType));
+				MSelectionList selection;
+				MObject meshNode;
+				if (selection.add(meshInfo->name) == MS::kSuccess && selection.getDependNode(0, meshNode) == MS::kSuccess && meshNode.hasFn(MFn::kMesh)) {
+					MFnMesh mesh(meshNode);
+					sendNewMesh(mesh, false);
+				}
+			}
+		}
+		delete[] msg;
+		msgSize = g_viewerComlib.nextSize();
+	}
+	return received;
+}
+
+void requestContentHashes() {
+	receiveViewerMessages(); //Anything already waiting is from before the plugin was loaded
+
+	MessageType type = HASHES_REQUESTED;
+	g_sender->send(&type, sizeof(MessageType));
+
+	//A viewer that isn't running never answers, everything is then sent as usual
+	for (int waited = 0; waited < HASH_REPLY_TIMEOUT; waited++) {
+		if (receiveViewerMessages()) {
+			cout << "The viewer already has " << g_meshHashes.size() << " meshes and " << g_materialHashes.size() << " materials" << endl;
+			return;
+		}
+		Sleep(1);
 	}
+	g_meshHashes.clear();
+	g_materialHashes.clear();
+	g_meshContent.clear();
+}
+
+void addClipFrame(std::vector<float>& samples, const float* values, size_t channelCount, size_t rotationOffset) {
+	size_t frameStart = samples.size();
+	samples.insert(samples.end(), values, values + channelCount);
+
+	//q and -q are the same rotation, the one closest to the previous frame is kept so the viewer interpolates the short way
+	if (frameStart >= channelCount) {
+		float* rotation = &samples[frameStart + rotationOffset];
+		const float* previous = &samples[frameStart - channelCount + rotationOffset];
+		if (rotation[0] * previous[0] + rotation[1] * previous[1] + rotation[2] * previous[2] + rotation[3] * previous[3] < 0.0f) {
+			for (int i = 0; i < 4; i++) {
+				rotation[i] = -rotation[i];
+			}
+		}
+	}
+}
+
+void bakeClip() {
+	//Maya can only be evaluated on the main thread, every frame is sampled here and the sender thread encodes the clip
+	MStatus status = MS::kSuccess;
+	MTime::Unit unit = MTime::uiUnit();
+	double startFrame = MAnimControl::minTime().as(unit);
+	double endFrame = MAnimControl::maxTime().as(unit);
+	MTime currentTime = MAnimControl::currentTime();
+
+	ClipCapture* clip = new ClipCapture;
+	clip->info.frameCount = (size_t)(endFrame - startFrame + 0.5) + 1;
+	if (clip->info.frameCount > MAX_CLIP_FRAMES) {
+		cout << "Only the first " << MAX_CLIP_FRAMES << " frames of the playback range are sent to the viewer" << endl;
+		clip->info.frameCount = MAX_CLIP_FRAMES;
+	}
+	clip->info.frameRate = (float)MTime(1.0, MTime::kSeconds).as(unit);
+	double currentFrame = currentTime.as(unit) - startFrame + 0.5;
+	clip->info.currentFrame = currentFrame < 0.0 ? 0 : (size_t)currentFrame;
+	if (clip->info.currentFrame >= clip->info.frameCount) {
+		clip->info.currentFrame = clip->info.frameCount - 1;
+	}
+
+	//Everything that can move gets a track, the ones that don't are removed after sampling
+	MObjectArray transforms;
+	MItDag transformIt(MItDag::kDepthFirst, MFn::kTransform, &status);
+	if (status == MS::kSuccess) {
+		while (!transformIt.isDone()) {
+			MObject transform = transformIt.currentItem();
+			if (!isCameraTransform(transform)) {
+				transforms.append(transform);
+				clip->addTrack(MFnDependencyNode(transform).name().asChar(), TRANSFORM_TRACK, 10);
+			}
+			transformIt.next();
+		}
+	}
+
+	MDagPath camPath;
+	size_t cameraTrack = clip->tracks.size();
+	bool hasCamera = M3dView::active3dView().getCamera(camPath) == MS::kSuccess;
+	if (hasCamera) {
+		clip->addTrack(MFnCamera(camPath).name().asChar(), CAMERA_TRACK, 7);
+	}
+
+	size_t skinTrack = clip->tracks.size();
+	std::vector<size_t> skins; //Index in g_skins
+	for (size_t i = 0; i < g_skins.size(); i++) {
+		if (g_skins[i].mesh.isValid() && g_skins[i].skinCluster.isValid()) {
+			skins.push_back(i);
+			clip->addTrack(MFnDependencyNode(g_skins[i].mesh.object()).name().asChar(), SKIN_TRACK, 16 * g_skins[i].joints.length());
+		}
+	}
+
+	//Skinned meshes move with their joints. The others only get a track once their points are seen moving,
+	//every frame before that is the same as the first
+	struct BakedMesh {
+		MObject node;
+		std::vector<float> firstPoints;
+		int track = -1;
+		bool skipped = false; //The topology changes within the range
+	};
+	std::vector<BakedMesh> meshes;
+	MItDag meshIt(MItDag::kDepthFirst, MFn::kMesh, &status);
+	if (status == MS::kSuccess) {
+		while (!meshIt.isDone()) {
+			MFnMesh mesh = meshIt.item();
+			MObject meshNode = mesh.object();
+			if (!mesh.isIntermediateObject() && findSkin(meshNode) == NULL) {
+				meshes.push_back(BakedMesh());
+				meshes.back().node = meshNode;
+			}
+			meshIt.next();
+		}
+	}
+
+	//Sample every frame. Every animated node fires its callbacks while the time moves, none of it is a change to send
+	g_changes.suspend();
+	for (size_t frame = 0; frame < clip->info.frameCount; frame++) {
+		MAnimControl::setCurrentTime(MTime(startFrame + frame, unit));
+
+		for (unsigned int i = 0; i < transforms.length(); i++) {
+			TransformMessage transformInfo;
+			getTransformData(transformInfo, transforms[i]);
+			float values[10];
+			memcpy(values, transformInfo.translation, sizeof(float) * 3);
+			memcpy(values + 3, transformInfo.rotation, sizeof(float) * 4);
+			memcpy(values + 7, transformInfo.scale, sizeof(float) * 3);
+			addClipFrame(clip->samples[i], values, 10, 3);
+		}
+
+		if (hasCamera) {
+			MTransformationMatrix camMatrix(camPath.inclusiveMatrix());
+			MVector translation = camMatrix.getTranslation(MSpace::kWorld);
+			double rotation[4];
+			camMatrix.getRotationQuaternion(rotation[0], rotation[1], rotation[2], rotation[3]);
+			float values[7] = { (float)translation.x, (float)translation.y, (float)translation.z,
+				(float)rotation[0], (float)rotation[1], (float)rotation[2], (float)rotation[3] };
+			addClipFrame(clip->samples[cameraTrack], values, 7, 3);
+		}
+
+		for (size_t i = 0; i < skins.size(); i++) {
+			std::vector<JointPoseMessage> poses;
+			getJointPoses(poses, g_skins[skins[i]]);
+			const float* values = (const float*)poses.data();
+			clip->samples[skinTrack + i].insert(clip->samples[skinTrack + i].end(), values, values + 16 * poses.size());
+		}
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (meshes[i].skipped) {
+				continue;
+			}
+			MFnMesh mesh(meshes[i].node);
+			const float* points = mesh.getRawPoints(&status);
+			size_t valueCount = (size_t)mesh.numVertices() * 3;
+			if (status != MS::kSuccess) {
+				meshes[i].skipped = true;
+				continue;
+			}
+
+			if (frame == 0) {
+				meshes[i].firstPoints.assign(points, points + valueCount);
+				continue;
+			}
+			if (valueCount != meshes[i].firstPoints.size()) {
+				meshes[i].skipped = true;
+				continue;
+			}
+			if (meshes[i].track < 0) {
+				if (memcmp(points, meshes[i].firstPoints.data(), sizeof(float) * valueCount) == 0) {
+					continue;
+				}
+				meshes[i].track = (int)clip->addTrack(mesh.name().asChar(), POINTS_TRACK, valueCount);
+				for (size_t j = 0; j < frame; j++) {
+					clip->samples[meshes[i].track].insert(clip->samples[meshes[i].track].end(), meshes[i].firstPoints.begin(), meshes[i].firstPoints.end());
+				}
+			}
+			clip->samples[meshes[i].track].insert(clip->samples[meshes[i].track].end(), points, points + valueCount);
+		}
+	}
+	MAnimControl::setCurrentTime(currentTime); //Back where it started, so nothing needs to be sent for it either
+	g_changes.resume();
+
+	//The viewer rebuilds the vertices it has from the points of every frame, the normals are kept as they are now
+	for (size_t i = 0; i < meshes.size(); i++) {
+		if (meshes[i].track < 0 || meshes[i].skipped) {
+			continue;
+		}
+		MFnMesh mesh(meshes[i].node);
+		MeshCapture capture;
+		MObjectArray shaders;
+		captureMesh(capture, mesh, shaders);
+		size_t track = meshes[i].track;
+		clip->tracks[track].vertexCount = capture.getCornerCount();
+		clip->vertices[track].resize(clip->tracks[track].vertexCount);
+		assembleVerticesParallel(capture.getArrays(), clip->vertices[track].data(), *g_threadPool);
+		clip->pointIndices[track].resize(clip->tracks[track].vertexCount);
+		assemblePointIndices(capture.getArrays(), clip->pointIndices[track].data());
+	}
+
+	//Nothing is sent for what didn't move
+	for (size_t i = clip->tracks.size(); i-- > 0;) {
+		bool constant = clip->tracks[i].type == POINTS_TRACK ? clip->tracks[i].vertexCount == 0 : clip->isConstant(i);
+		if (constant) {
+			clip->removeTrack(i);
+		}
+	}
+
+	//The message has to fit inside the shared buffer, the meshes with the most points are played without deforming
+	while (clip->getSizeBound() > CLIP_SIZE_LIMIT) {
+		size_t largest = clip->tracks.size();
+		for (size_t i = 0; i < clip->tracks.size(); i++) {
+			if (clip->tracks[i].type == POINTS_TRACK && (largest == clip->tracks.size() || clip->tracks[i].channelCount > clip->tracks[largest].channelCount)) {
+				largest = i;
+			}
+		}
+		if (largest == clip->tracks.size()) {
+			break;
+		}
+		cout << "The points of " << clip->tracks[largest].name << " are left out of the clip, there are too many" << endl;
+		clip->removeTrack(largest);
+	}
+
+	cout << "Sending a clip of " << clip->info.frameCount << " frames with " << clip->info.trackCount << " tracks to the viewer" << endl;
+	g_sender->sendClip(clip);
 }
@@ -25,16 +25,25 @@
 #include <maya/MFnBlinnShader.h>
 #include <maya/MFnPhongShader.h>
 #include <maya/MFnPointLight.h>
+#include <maya/MFnDirectionalLight.h>
+#include <maya/MFnSpotLight.h>
+#include <maya/MFnSkinCluster.h>
+#include <maya/MFnMatrixData.h>
+#include <maya/MFnSingleIndexedComponent.h>
 
 #include <maya/MImage.h>
 #include <maya/MFloatPointArray.h>
 #include <maya/MPointArray.h>
 #include <maya/MIntArray.h>
+#include <maya/MDoubleArray.h>
+#include <maya/MFloatVectorArray.h>
+#include <maya/MDagPathArray.h>
 #include <maya/MPoint.h>
 #include <maya/MMatrix.h>
 #include <maya/MEulerRotation.h>
 #include <maya/MVector.h>
 #include <maya/MItDag.h>
+#include <maya/MItDependencyGraph.h>
 #include <maya/M3dView.h>
 #include <maya/MItMeshPolygon.h>
 #include <maya/MPlugArray.h>
@@ -42,6 +51,7 @@
 #include <maya/MItDependencyNodes.h>
 #include <maya/MFnNumericAttribute.h>
 #include <maya/MTimer.h>
+#include <maya/MAnimControl.h>
 
 // Wrappers
 #include <maya/MGlobal.h>
@@ -55,6 +65,7 @@
 #include <maya/MPolyMessage.h>
 #include <maya/MNodeMessage.h>
 #include <maya/MDagPath.h>
+#include <maya/MObjectHandle.h>
 #include <maya/MDagMessage.h>
 #include <maya/MUiMessage.h>
 #include <maya/MModelMessage.h>
@@ -66,4 +77,5 @@
 // This can be also done in the properties setting for the project.
 #pragma comment(lib,"Dependencies/Foundation.lib")
 #pragma comment(lib,"Dependencies/OpenMaya.lib")
-#pragma comment(lib,"Dependencies/OpenMayaUI.lib")
\ No newline at end of file
+#pragma comment(lib,"Dependencies/OpenMayaUI.lib")
+#pragma comment(lib,"Dependencies/OpenMayaAnim.lib")
\ No newline at end of file
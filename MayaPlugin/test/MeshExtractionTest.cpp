@@ -0,0 +1,307 @@
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "MeshExtraction.h"
+
+/*
+ * Checks the Maya independent mesh assembly against the face-vertex arrays it is built from, then times it.
+ * The meshes are laid out the way MFnMesh returns them, with fan triangulated polygons.
+ * The parallel assembly has to match the serial one byte for byte, both are timed on the same grid.
+ * Usage: MeshExtractionTest [benchmark grid size] [repeats] [threads]
+ */
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+	if (!condition) {
+		std::cout << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+//Adds a polygon over the given points, with a UV per face-vertex when uvs is set
+static void addPolygon(MeshCapture& mesh, const std::vector<int>& points, bool uvs, int part = 0) {
+	int vertexCount = (int)points.size();
+	mesh.polygonCounts.push_back(vertexCount);
+	mesh.triangleCounts.push_back(vertexCount - 2);
+	for (int triangle = 0; triangle < vertexCount - 2; triangle++) {
+		mesh.triangleOffsets.push_back(0);
+		mesh.triangleOffsets.push_back(triangle + 1);
+		mesh.triangleOffsets.push_back(triangle + 2);
+	}
+
+	mesh.uvCounts.push_back(uvs ? vertexCount : 0);
+	for (int i = 0; i < vertexCount; i++) {
+		mesh.polygonVertices.push_back(points[i]);
+		mesh.normalIds.push_back((int)mesh.normals.size() / 3);
+		mesh.normals.push_back(0.0f);
+		mesh.normals.push_back((float)points[i]);
+		mesh.normals.push_back(1.0f);
+		if (uvs) {
+			mesh.uvIds.push_back((int)mesh.us.size());
+			mesh.us.push_back((float)points[i] * 0.5f);
+			mesh.vs.push_back((float)mesh.us.size());
+		}
+	}
+	mesh.polygonParts.push_back(part);
+}
+
+//Points on a line, every point can be told apart by its position
+static void addPoints(MeshCapture& mesh, int count) {
+	for (int i = 0; i < count; i++) {
+		mesh.points.push_back((float)i);
+		mesh.points.push_back((float)(i * i));
+		mesh.points.push_back(-1.0f);
+	}
+}
+
+//The vertices assembleVertices should write, looked up face-vertex by face-vertex in part order
+static std::vector<VertexMessage> expectedVertices(const MeshCapture& mesh) {
+	std::vector<VertexMessage> vertices;
+	size_t partCount = mesh.polygonParts.empty() ? 1 : mesh.partCount;
+	for (size_t part = 0; part < partCount; part++) {
+		size_t cornerOffset = 0;
+		size_t faceVertexOffset = 0;
+		size_t uvOffset = 0;
+		for (size_t polygon = 0; polygon < mesh.polygonCounts.size(); polygon++) {
+			size_t cornerCount = (size_t)mesh.triangleCounts[polygon] * 3;
+			if (mesh.polygonParts.empty() || (size_t)mesh.polygonParts[polygon] == part) {
+				for (size_t corner = 0; corner < cornerCount; corner++) {
+					int localIndex = mesh.triangleOffsets[cornerOffset + corner];
+					size_t faceVertex = faceVertexOffset + localIndex;
+					VertexMessage vertex;
+					for (int i = 0; i < 3; i++) {
+						vertex.pos[i] = mesh.points[mesh.polygonVertices[faceVertex] * 3 + i];
+						vertex.normal[i] = mesh.normals[mesh.normalIds[faceVertex] * 3 + i];
+					}
+					if (mesh.uvCounts[polygon] > 0) {
+						vertex.uv[0] = mesh.us[mesh.uvIds[uvOffset + localIndex]];
+						vertex.uv[1] = mesh.vs[mesh.uvIds[uvOffset + localIndex]];
+					}
+					vertices.push_back(vertex);
+				}
+			}
+			cornerOffset += cornerCount;
+			faceVertexOffset += mesh.polygonCounts[polygon];
+			uvOffset += mesh.uvCounts[polygon];
+		}
+	}
+	return vertices;
+}
+
+static bool sameVertices(const std::vector<VertexMessage>& a, const std::vector<VertexMessage>& b) {
+	if (a.size() != b.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < a.size(); i++) {
+		for (int j = 0; j < 3; j++) {
+			if (a[i].pos[j] != b[i].pos[j] || a[i].normal[j] != b[i].normal[j]) {
+				return false;
+			}
+		}
+		if (a[i].uv[0] != b[i].uv[0] || a[i].uv[1] != b[i].uv[1]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static std::vector<VertexMessage> assemble(const MeshCapture& mesh) {
+	//Filled with garbage, every vertex has to be written
+	std::vector<VertexMessage> vertices(mesh.getCornerCount());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		vertices[i].uv[0] = -123.0f;
+	}
+	size_t written = assembleVertices(mesh.getArrays(), vertices.data());
+	check(written == vertices.size(), "every triangle corner is written");
+	return vertices;
+}
+
+static void testNGons() {
+	//A triangle, a quad, a pentagon and a hexagon sharing points
+	MeshCapture mesh;
+	addPoints(mesh, 8);
+	addPolygon(mesh, { 0, 1, 2 }, true);
+	addPolygon(mesh, { 0, 2, 3, 4 }, true);
+	addPolygon(mesh, { 4, 3, 5, 6, 7 }, true);
+	addPolygon(mesh, { 7, 6, 5, 3, 2, 1 }, true);
+	mesh.polygonParts.clear();
+
+	check(mesh.getCornerCount() == 3 * (1 + 2 + 3 + 4), "n-gons are fan triangulated");
+	check(sameVertices(assemble(mesh), expectedVertices(mesh)), "n-gon vertices match their face-vertices");
+
+	std::vector<size_t> corners = countPartCorners(mesh.getArrays());
+	check(corners.size() == 1 && corners[0] == 30, "n-gons without parts are one part");
+}
+
+static void testNGonParts() {
+	//The vertices of every part are kept together, in polygon order within the part
+	MeshCapture mesh;
+	addPoints(mesh, 8);
+	addPolygon(mesh, { 0, 1, 2, 3, 4 }, true, 1);
+	addPolygon(mesh, { 0, 2, 3 }, true, 0);
+	addPolygon(mesh, { 7, 6, 5, 4 }, true, 1);
+	addPolygon(mesh, { 1, 2, 5, 6, 7, 3 }, true, 2);
+	mesh.partCount = 4; //The last part has no polygons
+
+	std::vector<size_t> corners = countPartCorners(mesh.getArrays());
+	check(corners.size() == 4, "one count per part");
+	check(corners[0] == 3 && corners[1] == 9 + 6 && corners[2] == 12 && corners[3] == 0, "corners are counted per part");
+	check(sameVertices(assemble(mesh), expectedVertices(mesh)), "n-gon vertices end up in part order");
+}
+
+static void testMissingUVs() {
+	//Only some polygons have UVs, the UV ids of the others are not in uvIds at all
+	MeshCapture mesh;
+	addPoints(mesh, 6);
+	addPolygon(mesh, { 0, 1, 2, 3 }, false);
+	addPolygon(mesh, { 1, 2, 4 }, true);
+	addPolygon(mesh, { 2, 3, 4, 5 }, false);
+	addPolygon(mesh, { 0, 3, 5, 4, 1 }, true);
+	mesh.polygonParts.clear();
+
+	std::vector<VertexMessage> vertices = assemble(mesh);
+	check(sameVertices(vertices, expectedVertices(mesh)), "UVs are only read for polygons that have them");
+	check(vertices[0].uv[0] == 0.0f && vertices[0].uv[1] == 0.0f, "polygons without UVs get zero UVs");
+
+	//Not a single UV in the mesh
+	MeshCapture bare;
+	addPoints(bare, 4);
+	addPolygon(bare, { 0, 1, 2, 3 }, false);
+	addPolygon(bare, { 3, 2, 1 }, false);
+	bare.polygonParts.clear();
+	check(sameVertices(assemble(bare), expectedVertices(bare)), "a mesh without any UVs is assembled");
+}
+
+static void testEmptyMeshes() {
+	MeshCapture empty;
+	std::vector<VertexMessage> vertices(1);
+	check(assembleVertices(empty.getArrays(), vertices.data()) == 0, "an empty mesh writes no vertices");
+	std::vector<size_t> corners = countPartCorners(empty.getArrays());
+	check(corners.size() == 1 && corners[0] == 0, "an empty mesh is one empty part");
+
+	//Points but no polygons, and parts that no polygon is in
+	MeshCapture noPolygons;
+	addPoints(noPolygons, 3);
+	noPolygons.partCount = 2;
+	check(assembleVertices(noPolygons.getArrays(), vertices.data()) == 0, "a mesh without polygons writes no vertices");
+}
+
+//Quads over an n by n grid of points, how a dense Maya mesh is usually built.
+//With parts the quads are spread over them, and every seventh quad is left without UVs
+static void buildGrid(MeshCapture& mesh, int size, int partCount = 0) {
+	for (int y = 0; y <= size; y++) {
+		for (int x = 0; x <= size; x++) {
+			mesh.points.push_back((float)x);
+			mesh.points.push_back(0.0f);
+			mesh.points.push_back((float)y);
+		}
+	}
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			int corner = y * (size + 1) + x;
+			int polygon = y * size + x;
+			bool uvs = partCount == 0 || polygon % 7 != 0;
+			addPolygon(mesh, { corner, corner + 1, corner + size + 2, corner + size + 1 }, uvs, partCount > 0 ? polygon % partCount : 0);
+		}
+	}
+	if (partCount > 0) {
+		mesh.partCount = partCount;
+	}
+	else {
+		mesh.polygonParts.clear();
+	}
+}
+
+static std::vector<VertexMessage> assembleParallel(const MeshCapture& mesh, ThreadPool& pool) {
+	std::vector<VertexMessage> vertices(mesh.getCornerCount());
+	size_t written = assembleVerticesParallel(mesh.getArrays(), vertices.data(), pool);
+	check(written == vertices.size(), "every triangle corner is written in parallel");
+	return vertices;
+}
+
+static void testParallel() {
+	//Big enough to be split over the pool
+	MeshCapture grid;
+	buildGrid(grid, 120);
+	MeshCapture partGrid;
+	buildGrid(partGrid, 120, 3);
+	MeshCapture small;
+	buildGrid(small, 10, 2);
+
+	ThreadPool pool(3);
+	check(sameVertices(assembleParallel(grid, pool), assemble(grid)), "parallel assembly matches the serial one");
+	check(sameVertices(assembleParallel(partGrid, pool), assemble(partGrid)), "parallel assembly keeps the parts together");
+	check(sameVertices(assembleParallel(small, pool), assemble(small)), "small meshes are assembled on the calling thread");
+
+	ThreadPool noWorkers(0);
+	check(sameVertices(assembleParallel(partGrid, noWorkers), assemble(partGrid)), "a pool without workers assembles on the calling thread");
+
+	//The plugin's main thread and sender thread share one pool
+	std::vector<VertexMessage> expected = assemble(partGrid);
+	bool sameOnOtherThread = true;
+	std::thread other([&] {
+		for (int i = 0; i < 20; i++) {
+			sameOnOtherThread = sameOnOtherThread && sameVertices(assembleParallel(partGrid, pool), expected);
+		}
+	});
+	bool sameOnThisThread = true;
+	for (int i = 0; i < 20; i++) {
+		sameOnThisThread = sameOnThisThread && sameVertices(assembleParallel(partGrid, pool), expected);
+	}
+	other.join();
+	check(sameOnOtherThread && sameOnThisThread, "two threads can assemble on the same pool");
+}
+
+//Returns the seconds one assembly took on average, pool is only used when set
+static double benchmarkAssembly(const MeshCapture& mesh, int repeats, ThreadPool* pool, const char* name) {
+	std::vector<VertexMessage> vertices(mesh.getCornerCount());
+	MeshArrays arrays = mesh.getArrays();
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeats; i++) {
+		if (pool != nullptr) {
+			assembleVerticesParallel(arrays, vertices.data(), *pool);
+		}
+		else {
+			assembleVertices(arrays, vertices.data());
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / repeats;
+	double megabytes = vertices.size() * sizeof(VertexMessage) / (1024.0 * 1024.0);
+	std::cout << name << ": " << mesh.polygonCounts.size() << " polygons in " << seconds * 1000.0 << " ms, "
+		<< vertices.size() / seconds / 1000000.0 << " M vertices/s, " << megabytes / seconds << " MB/s" << std::endl;
+	return seconds;
+}
+
+int main(int argc, char** argv) {
+	int gridSize = argc > 1 ? atoi(argv[1]) : 1000;
+	int repeats = argc > 2 ? atoi(argv[2]) : 10;
+	unsigned int threadCount = argc > 3 ? (unsigned int)atoi(argv[3]) : std::thread::hardware_concurrency();
+
+	testNGons();
+	testNGonParts();
+	testMissingUVs();
+	testEmptyMeshes();
+	testParallel();
+	if (failures > 0) {
+		std::cout << failures << " checks failed" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "All checks passed" << std::endl;
+
+	if (gridSize > 0 && repeats > 0) {
+		MeshCapture grid;
+		buildGrid(grid, gridSize);
+		double serialSeconds = benchmarkAssembly(grid, repeats, nullptr, "assembleVertices");
+
+		//Sized like the plugin's pool, the main thread works as well
+		ThreadPool pool(threadCount > 1 ? threadCount - 1 : 0);
+		double parallelSeconds = benchmarkAssembly(grid, repeats, &pool, "assembleVerticesParallel");
+		std::cout << pool.getThreadCount() << " threads, " << serialSeconds / parallelSeconds << "x the serial speed" << std::endl;
+	}
+	return EXIT_SUCCESS;
+}
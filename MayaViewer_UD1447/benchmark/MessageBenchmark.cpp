@@ -0,0 +1,190 @@
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "MessageReceiver.h"
+#include "MeshUpload.h"
+
+/*
+ * Drives MessageReceiver the way the viewer does, without a window or a scene.
+ * A producer thread sends synthetic messages through a ComLib of its own while the main thread takes them like the render thread,
+ * so the ingest thread receives and parses them with the same buffer sizes as the viewer.
+ * Mesh messages also go through what the viewer does before the upload, reading the vertices where they were received.
+ * Usage: MessageBenchmark [messages] [vertices per mesh]
+ */
+
+static const size_t COMLIB_SIZE = 200; //Megabytes, same as the viewer
+static const size_t QUEUE_SIZE = 4096;
+static const size_t QUEUE_BYTES = 256 << 20;
+
+struct Workload {
+	std::vector<char> transform;
+	std::vector<char> view;
+	std::vector<char> mesh;
+	std::vector<SkinWeightMessage> weights; //For applying the mesh as if it were skinned
+};
+
+//Time and vertex bytes spent applying meshes, split by whether they could be uploaded straight from the arena
+struct ApplyStatistics {
+	double directSeconds = 0.0;
+	size_t directBytes = 0;
+	double packedSeconds = 0.0;
+	size_t packedBytes = 0;
+};
+
+//What updateModel does with a mesh before the GL upload, returns a value of the result to checksum
+static float applyMesh(const MessageReceiver::Message* message, const Workload& workload, bool skinned, std::vector<float>& vertexData, ApplyStatistics& statistics) {
+	auto start = std::chrono::steady_clock::now();
+	MeshMessage* meshInfo = (MeshMessage*)(message->data + sizeof(MessageHeader));
+	MeshPartMessage* parts = (MeshPartMessage*)(message->data + sizeof(MessageHeader) + sizeof(MeshMessage));
+	VertexMessage* vertices = (VertexMessage*)(parts + meshInfo->partCount);
+
+	BoundingBox box;
+	BoundingSphere sphere;
+	computeMeshBounds(vertices, meshInfo->vertexCount, &box, &sphere);
+	size_t writeCount;
+	const float* data = (const float*)packVertices(vertices, skinned ? workload.weights.data() : NULL, meshInfo->vertexCount, meshInfo->vertexCount,
+		skinned ? 16 : 8, vertexData, &writeCount);
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (skinned) {
+		statistics.packedSeconds += seconds;
+		statistics.packedBytes += sizeof(VertexMessage) * meshInfo->vertexCount;
+	}
+	else {
+		statistics.directSeconds += seconds;
+		statistics.directBytes += sizeof(VertexMessage) * meshInfo->vertexCount;
+	}
+	return sphere.radius + (writeCount > 0 ? data[0] : 0.0f);
+}
+
+static void buildWorkload(Workload& workload, size_t vertexCount) {
+	MessageHeader header;
+
+	//What dragging an object sends
+	header.type = TRANSFORM_CHANGED;
+	TransformMessage transformInfo;
+	strcpy(transformInfo.name, "pCube1");
+	transformInfo.translation[0] = 1.0f;
+	workload.transform.resize(sizeof(MessageHeader) + sizeof(TransformMessage));
+	memcpy(workload.transform.data(), &header, sizeof(MessageHeader));
+	memcpy(workload.transform.data() + sizeof(MessageHeader), &transformInfo, sizeof(TransformMessage));
+
+	//What tumbling the camera sends, decomposed on the ingest thread
+	header.type = VIEW_CHANGED;
+	CameraMessage camInfo;
+	strcpy(camInfo.name, "persp");
+	Matrix camMatrix;
+	Matrix::createLookAt(Vector3(10.0f, 10.0f, 10.0f), Vector3::zero(), Vector3::unitY(), &camMatrix);
+	camMatrix.invert();
+	memcpy(camInfo.transformationMatrix, camMatrix.m, sizeof(camInfo.transformationMatrix));
+	workload.view.resize(sizeof(MessageHeader) + sizeof(CameraMessage));
+	memcpy(workload.view.data(), &header, sizeof(MessageHeader));
+	memcpy(workload.view.data() + sizeof(MessageHeader), &camInfo, sizeof(CameraMessage));
+
+	//What editing a mesh sends
+	header.type = MESH_TOPOLOGY_CHANGED;
+	MeshMessage meshInfo;
+	strcpy(meshInfo.name, "pCubeShape1");
+	meshInfo.vertexCount = vertexCount;
+	meshInfo.partCount = 1;
+	MeshPartMessage part;
+	part.vertexCount = vertexCount;
+	workload.mesh.resize(sizeof(MessageHeader) + sizeof(MeshMessage) + sizeof(MeshPartMessage) + sizeof(VertexMessage) * vertexCount);
+	char* msg = workload.mesh.data();
+	memcpy(msg, &header, sizeof(MessageHeader));
+	memcpy(msg + sizeof(MessageHeader), &meshInfo, sizeof(MeshMessage));
+	memcpy(msg + sizeof(MessageHeader) + sizeof(MeshMessage), &part, sizeof(MeshPartMessage));
+	VertexMessage* vertices = (VertexMessage*)(msg + sizeof(MessageHeader) + sizeof(MeshMessage) + sizeof(MeshPartMessage));
+	for (size_t i = 0; i < vertexCount; i++) {
+		vertices[i].pos[0] = (float)i;
+		vertices[i].normal[1] = 1.0f;
+	}
+
+	workload.weights.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++) {
+		workload.weights[i].weights[0] = 1.0f;
+		workload.weights[i].joints[0] = (float)(i % MAX_SKIN_JOINTS);
+	}
+}
+
+int main(int argc, char** argv) {
+	size_t messageCount = argc > 1 ? (size_t)atol(argv[1]) : 200000;
+	size_t vertexCount = argc > 2 ? (size_t)atol(argv[2]) : 30000;
+
+	Workload workload;
+	buildWorkload(workload, vertexCount);
+
+	//The producer resets the buffer, so it is created first
+	ComLib producer("MessageBenchmark", COMLIB_SIZE, ComLib::PRODUCER);
+	ComLib consumer("MessageBenchmark", COMLIB_SIZE, ComLib::CONSUMER);
+
+	size_t sentBytes = 0;
+	size_t retries = 0;
+	auto start = std::chrono::steady_clock::now();
+	std::thread sender([&] {
+		//Mostly transforms and views with a mesh now and then, like working in Maya
+		for (size_t i = 0; i < messageCount; i++) {
+			const std::vector<char>& msg = i % 100 == 99 ? workload.mesh : (i % 2 == 0 ? workload.transform : workload.view);
+			while (producer.send(msg.data(), msg.size()) == false) {
+				retries++;
+				std::this_thread::yield();
+			}
+			sentBytes += msg.size();
+		}
+	});
+
+	size_t takenMessages = 0;
+	size_t takenBytes = 0;
+	size_t dropped = 0;
+	float checksum = 0.0f; //Keeps the reads below from being optimized away
+	ApplyStatistics applyStatistics;
+	std::vector<float> vertexData; //Reused like the viewer would if it kept one, so only the packing is timed
+	size_t meshCount = 0;
+	{
+		MessageReceiver receiver(consumer, QUEUE_SIZE, QUEUE_BYTES);
+		while (takenMessages + dropped < messageCount) {
+			const MessageReceiver::Message* message = receiver.front();
+			if (message == NULL) {
+				dropped = receiver.getStatistics().dropped; //None are expected, but they would never arrive
+				std::this_thread::yield();
+				continue;
+			}
+			if (message->type == VIEW_CHANGED) {
+				checksum += message->viewTranslation.x;
+			}
+			else if (message->type == MESH_TOPOLOGY_CHANGED) {
+				//Every other mesh is applied as skinned, its weights are interleaved into a copy
+				checksum += applyMesh(message, workload, meshCount++ % 2 == 1, vertexData, applyStatistics);
+			}
+			else {
+				checksum += (float)message->data[message->size - 1];
+			}
+			takenMessages++;
+			takenBytes += message->size;
+			receiver.pop();
+		}
+		sender.join();
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double megabytes = takenBytes / (1024.0 * 1024.0);
+		MessageReceiver::Statistics statistics = receiver.getStatistics();
+		std::cout << takenMessages << " messages (" << megabytes << " MB) in " << seconds << " s: "
+			<< takenMessages / seconds << " messages/s, " << megabytes / seconds << " MB/s" << std::endl;
+		std::cout << "Receiving and parsing: " << (statistics.receiveSeconds > 0.0 ? megabytes / statistics.receiveSeconds : 0.0) << " MB/s, "
+			<< statistics.dropped << " dropped, " << (statistics.peakQueuedBytes >> 10) << " KB peak queued, "
+			<< retries << " sends had to be retried" << std::endl;
+		std::cout << "Applying meshes: " << (applyStatistics.directSeconds > 0.0 ? applyStatistics.directBytes / (1024.0 * 1024.0) / applyStatistics.directSeconds : 0.0)
+			<< " MB/s uploaded straight from the arena, " << (applyStatistics.packedSeconds > 0.0 ? applyStatistics.packedBytes / (1024.0 * 1024.0) / applyStatistics.packedSeconds : 0.0)
+			<< " MB/s packed with skin weights" << std::endl;
+	}
+	if (dropped > 0 || sentBytes != takenBytes) {
+		std::cout << "Sent " << sentBytes << " bytes but took " << takenBytes << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "Checksum " << checksum << std::endl;
+	return EXIT_SUCCESS;
+}
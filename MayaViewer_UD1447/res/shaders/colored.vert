@@ -15,6 +15,10 @@
 // Attributes
 attribute vec4 a_position;
 
+#if defined(INSTANCED)
+attribute mat4 a_instanceMatrix;
+#endif
+
 #if defined(SKINNING)
 attribute vec4 a_blendWeights;
 attribute vec4 a_blendIndices;
@@ -34,14 +38,22 @@ attribute vec3 a_color;
 
 ///////////////////////////////////////////////////////////
 // Uniforms
+#if defined(INSTANCED)
+uniform mat4 u_viewProjectionMatrix;
+uniform mat4 u_viewMatrix;
+#else
 uniform mat4 u_worldViewProjectionMatrix;
+#endif
 
 #if defined(SKINNING)
 uniform vec4 u_matrixPalette[SKINNING_JOINT_COUNT * 3];
 #endif
 
-#if defined(LIGHTING)
+#if defined(LIGHTING) && !defined(INSTANCED)
 uniform mat4 u_inverseTransposeWorldViewMatrix;
+#endif
+
+#if defined(LIGHTING)
 
 #if (POINT_LIGHT_COUNT > 0) || (SPOT_LIGHT_COUNT > 0) || defined(SPECULAR)
 uniform mat4 u_worldViewMatrix;
@@ -118,14 +130,26 @@ varying float v_clipDistance;
 void main()
 {
     vec4 position = getPosition();
+    #if defined(INSTANCED)
+    gl_Position = u_viewProjectionMatrix * (a_instanceMatrix * position);
+    #else
     gl_Position = u_worldViewProjectionMatrix * position;
+    #endif
 
     #if defined (LIGHTING)
 
     vec3 normal = getNormal();
 
     // Transform normal to view space.
+    #if defined(INSTANCED)
+    // The cofactors of the world view matrix are its inverse transpose scaled by the determinant, which only the sign is kept of
+    mat4 worldViewMatrix = u_viewMatrix * a_instanceMatrix;
+    mat3 worldView = mat3(worldViewMatrix[0].xyz, worldViewMatrix[1].xyz, worldViewMatrix[2].xyz);
+    mat3 inverseTransposeWorldViewMatrix = mat3(cross(worldView[1], worldView[2]), cross(worldView[2], worldView[0]), cross(worldView[0], worldView[1]));
+    inverseTransposeWorldViewMatrix *= sign(dot(worldView[0], inverseTransposeWorldViewMatrix[0]));
+    #else
     mat3 inverseTransposeWorldViewMatrix = mat3(u_inverseTransposeWorldViewMatrix[0].xyz, u_inverseTransposeWorldViewMatrix[1].xyz, u_inverseTransposeWorldViewMatrix[2].xyz);
+    #endif
     v_normalVector = inverseTransposeWorldViewMatrix * normal;
 
     // Apply light.
@@ -15,7 +15,7 @@ vec3 computeLighting(vec3 normalVector, vec3 lightDirection, vec3 lightColor, fl
     vec3 vertexToEye = normalize(v_cameraDirection);
     vec3 halfVector = normalize(lightDirection + vertexToEye);
     float specularAngle = clamp(dot(normalVector, halfVector), 0.0, 1.0);
-    vec3 specularColor = vec3(pow(specularAngle, u_specularExponent)) * attenuation;
+    vec3 specularColor = lightColor * pow(specularAngle, u_specularExponent) * attenuation;
 
     return diffuseColor + specularColor;
 
@@ -3,8 +3,12 @@
 void applyLight(vec4 position, mat3 tangentSpaceTransformMatrix)
 {
     #if (defined(SPECULAR) || (POINT_LIGHT_COUNT > 0) || (SPOT_LIGHT_COUNT > 0))
+    #if defined(INSTANCED)
+    vec4 positionWorldViewSpace = u_viewMatrix * (a_instanceMatrix * position);
+    #else
     vec4 positionWorldViewSpace = u_worldViewMatrix * position;
     #endif
+    #endif
     
     #if (DIRECTIONAL_LIGHT_COUNT > 0)
     for (int i = 0; i < DIRECTIONAL_LIGHT_COUNT; ++i)
@@ -40,8 +44,12 @@ void applyLight(vec4 position, mat3 tangentSpaceTransformMatrix)
 void applyLight(vec4 position)
 {
     #if defined(SPECULAR) || (POINT_LIGHT_COUNT > 0) || (SPOT_LIGHT_COUNT > 0)
+    #if defined(INSTANCED)
+    vec4 positionWorldViewSpace = u_viewMatrix * (a_instanceMatrix * position);
+    #else
 	vec4 positionWorldViewSpace = u_worldViewMatrix * position;
     #endif
+    #endif
 
     #if (POINT_LIGHT_COUNT > 0)
     for (int i = 0; i < POINT_LIGHT_COUNT; ++i)
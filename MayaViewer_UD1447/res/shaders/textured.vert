@@ -14,6 +14,9 @@
 ///////////////////////////////////////////////////////////
 // Atributes
 attribute vec4 a_position;
+#if defined(INSTANCED)
+attribute mat4 a_instanceMatrix;
+#endif
 
 #if defined(SKINNING)
 attribute vec4 a_blendWeights;
@@ -38,13 +41,21 @@ attribute vec3 a_binormal;
 
 ///////////////////////////////////////////////////////////
 // Uniforms
+#if defined(INSTANCED)
+uniform mat4 u_viewProjectionMatrix;
+uniform mat4 u_viewMatrix;
+#else
 uniform mat4 u_worldViewProjectionMatrix;
+#endif
 #if defined(SKINNING)
 uniform vec4 u_matrixPalette[SKINNING_JOINT_COUNT * 3];
 #endif
 
-#if defined(LIGHTING)
+#if defined(LIGHTING) && !defined(INSTANCED)
 uniform mat4 u_inverseTransposeWorldViewMatrix;
+#endif
+
+#if defined(LIGHTING)
 
 #if defined(SPECULAR) || (POINT_LIGHT_COUNT > 0) || (SPOT_LIGHT_COUNT > 0)
 uniform mat4 u_worldViewMatrix;
@@ -134,12 +145,24 @@ varying float v_clipDistance;
 void main()
 {
     vec4 position = getPosition();
+    #if defined(INSTANCED)
+    gl_Position = u_viewProjectionMatrix * (a_instanceMatrix * position);
+    #else
     gl_Position = u_worldViewProjectionMatrix * position;
+    #endif
 
     #if defined(LIGHTING)
     vec3 normal = getNormal();
     // Transform the normal, tangent and binormals to view space.
+    #if defined(INSTANCED)
+    // The cofactors of the world view matrix are its inverse transpose scaled by the determinant, which only the sign is kept of
+    mat4 worldViewMatrix = u_viewMatrix * a_instanceMatrix;
+    mat3 worldView = mat3(worldViewMatrix[0].xyz, worldViewMatrix[1].xyz, worldViewMatrix[2].xyz);
+    mat3 inverseTransposeWorldViewMatrix = mat3(cross(worldView[1], worldView[2]), cross(worldView[2], worldView[0]), cross(worldView[0], worldView[1]));
+    inverseTransposeWorldViewMatrix *= sign(dot(worldView[0], inverseTransposeWorldViewMatrix[0]));
+    #else
     mat3 inverseTransposeWorldViewMatrix = mat3(u_inverseTransposeWorldViewMatrix[0].xyz, u_inverseTransposeWorldViewMatrix[1].xyz, u_inverseTransposeWorldViewMatrix[2].xyz);
+    #endif
     vec3 normalVector = normalize(inverseTransposeWorldViewMatrix * normal);
     
     #if defined(BUMPED)
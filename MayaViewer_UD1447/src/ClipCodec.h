@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+/*
+ * Encoding of the sampled channels of a clip, shared by the plugin and the viewer.
+ * Every channel is quantized to 16 bits over its own range and the difference to the
+ * previous frame is written as a zigzag varint, so a slowly moving channel costs about a byte per frame.
+ * Channel layout: float minimum | float step | varint deltas[sampleCount]
+ * A constant channel has a step of 0 and no deltas.
+ */
+
+const unsigned int CLIP_QUANTIZE_MAX = 65535;
+
+//Appends the channel read from every stride:th float of samples
+inline void encodeChannel(const float* samples, size_t sampleCount, size_t stride, std::vector<unsigned char>& data) {
+	float minimum = samples[0];
+	float maximum = samples[0];
+	for (size_t i = 1; i < sampleCount; i++) {
+		float value = samples[i * stride];
+		minimum = value < minimum ? value : minimum;
+		maximum = value > maximum ? value : maximum;
+	}
+	float step = (maximum - minimum) / CLIP_QUANTIZE_MAX;
+
+	size_t offset = data.size();
+	data.resize(offset + sizeof(float) * 2);
+	memcpy(&data[offset], &minimum, sizeof(float));
+	memcpy(&data[offset + sizeof(float)], &step, sizeof(float));
+	if (step == 0.0f) {
+		return;
+	}
+
+	int previous = 0;
+	for (size_t i = 0; i < sampleCount; i++) {
+		int quantized = (int)((samples[i * stride] - minimum) / step + 0.5f);
+		quantized = quantized > (int)CLIP_QUANTIZE_MAX ? (int)CLIP_QUANTIZE_MAX : quantized;
+		int delta = quantized - previous;
+		previous = quantized;
+
+		unsigned int zigzag = delta < 0 ? ((unsigned int)(-delta) << 1) - 1 : (unsigned int)delta << 1;
+		while (zigzag >= 0x80) {
+			data.push_back((unsigned char)(zigzag | 0x80));
+			zigzag >>= 7;
+		}
+		data.push_back((unsigned char)zigzag);
+	}
+}
+
+//Writes the channel to every stride:th float of samples, returns where the next channel starts or NULL when data ends too soon
+inline const unsigned char* decodeChannel(const unsigned char* data, const unsigned char* end, size_t sampleCount, float* samples, size_t stride) {
+	if ((size_t)(end - data) < sizeof(float) * 2) {
+		return NULL;
+	}
+	float minimum, step;
+	memcpy(&minimum, data, sizeof(float));
+	memcpy(&step, data + sizeof(float), sizeof(float));
+	data += sizeof(float) * 2;
+
+	int quantized = 0;
+	for (size_t i = 0; i < sampleCount; i++) {
+		if (step != 0.0f) {
+			unsigned int zigzag = 0;
+			int shift = 0;
+			do {
+				if (data == end || shift > 28) {
+					return NULL;
+				}
+				zigzag |= (unsigned int)(*data & 0x7f) << shift;
+				shift += 7;
+			} while (*data++ & 0x80);
+			quantized += (zigzag & 1) ? -(int)((zigzag + 1) >> 1) : (int)(zigzag >> 1);
+		}
+		samples[i * stride] = minimum + quantized * step;
+	}
+	return data;
+}
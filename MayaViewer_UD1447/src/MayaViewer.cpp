@@ -8,13 +8,24 @@ static bool gKeys[256] = {};
 int gDeltaX;
 int gDeltaY;
 bool gMousePressed;
+static const char* gShaderPaths[2][2] = { //Vertex and fragment shader, colored and textured
+	{ "res/shaders/colored.vert", "res/shaders/colored.frag" },
+	{ "res/shaders/textured.vert", "res/shaders/textured.frag" }
+};
 
-MayaViewer::MayaViewer() : _scene(NULL), _wireframe(false), _comLib("MayaComLib", 200, ComLib::CONSUMER) {
+//Skinned meshes are created with the blend weights and indices after the position, normal and UV
+static bool isSkinned(Mesh* mesh) {
+	return mesh->getVertexFormat().getElementCount() > 3;
+}
+
+MayaViewer::MayaViewer() : _scene(NULL), _textures(NULL), _receiver(NULL), _wireframe(false), _instancing(false), _clipFrameCount(0), _clipFrameRate(0.0f), _clipCurrentFrame(0), _clipTime(0.0f), _clipPlaying(false), _messageBacklog(0), _peakMessageBacklog(0), _backlogFrames(0), _appliedBytes(0), _applySeconds(0.0), _drawReportTime(0.0f), _comLib("MayaComLib", 200, ComLib::CONSUMER), _viewerComLib("ViewerComLib", 8, ComLib::PRODUCER) {
 
 }
 
 void MayaViewer::initialize() {
 	DebugConsole::Init();
+	_receiver = new MessageReceiver(_comLib, MESSAGE_QUEUE_SIZE, MESSAGE_QUEUE_BYTES);
+	_textures = new TextureCache(TEXTURE_DECODE_THREADS);
     // Load game scene from file
 	_scene = Scene::create();
 
@@ -28,25 +39,69 @@ void MayaViewer::initialize() {
 	cameraNode->translate(0, 0, 10);
 	cameraNode->rotateX(MATH_DEG_TO_RAD(0.f));
 
-	_defaultLight = _scene->addNode("light");
+	_defaultLight = _scene->addNode("light"); //Only used while the Maya scene has no lights
 	Light* light = Light::createPoint(Vector3(0.5f, 0.5f, 0.5f), 20);
 	_defaultLight->setLight(light);
 	SAFE_RELEASE(light);
 	_defaultLight->translate(Vector3(0, 1, 5));
+
+	_instancing = Model::isInstancingSupported();
+	precompileShaders();
+
+	sendContentHashes(); //Tells a plugin that is already running that we start out empty
 }
 
 void MayaViewer::finalize() {
+	if (PRINT_MESSAGE_STATISTICS) {
+		printMessageStatistics();
+	}
+	delete _receiver; //Stops the ingest thread before anything it hands over goes away
+	_receiver = NULL;
+	for (size_t i = 0; i < _lightNodes.size(); i++) {
+		SAFE_RELEASE(_lightNodes[i]);
+	}
+	_lightNodes.clear();
+	_nodes.clear();
     SAFE_RELEASE(_scene);
+	for (auto& it : _instancedModels) {
+		SAFE_RELEASE(it.second);
+	}
+	_instancedModels.clear();
+	for (auto& it : _sharedMeshes) {
+		SAFE_RELEASE(it.second.mesh);
+	}
+	_sharedMeshes.clear();
+	for (auto& it : _materialTemplates) {
+		SAFE_RELEASE(it.second.material);
+		SAFE_RELEASE(it.second.skinnedMaterial);
+		SAFE_RELEASE(it.second.instancedMaterial);
+	}
+	_materialTemplates.clear();
+	_instancedMaterials.clear();
+	_blendedMaterials.clear();
+	for (size_t i = 0; i < _shaderVariants.size(); i++) {
+		SAFE_RELEASE(_shaderVariants[i]);
+	}
+	_shaderVariants.clear();
+	_materials.clear();
+	_models.clear();
+	_nodeSkins.clear();
+	delete _textures; //After the materials, which keep the textures alive otherwise
+	_textures = NULL;
 }
 
 void MayaViewer::update(float elapsedTime) {
-	for (int i = 0; i < 20; i++) { //Worse framerate but potentially better response
-		fetchMessage();
-	}
+	drainMessages();
 
 	static float totalTime = 0;
 	totalTime += elapsedTime;	
 
+	uploadTextures();
+
+	if (_clipPlaying) {
+		playClip(elapsedTime);
+	}
+
 	Node* camnode = _scene->getActiveCamera()->getNode();
 	if (gKeys[Keyboard::KEY_W])
 		camnode->translateForward(0.5);
@@ -67,136 +122,607 @@ void MayaViewer::render(float elapsedTime) {
     // Clear the color and depth buffers
     clear(CLEAR_COLOR_DEPTH, Vector4(0.25f, 0.35f, 0.58f, 1.0f), 1.0f, 0);
 
-    // Visit all the nodes in the scene for drawing
-    _scene->visit(this, &MayaViewer::drawScene);
-}
-
-bool MayaViewer::drawScene(Node* node) {
-    // If the node visited contains a drawable object, draw it
-    Drawable* drawable = node->getDrawable(); 
-    if (drawable)
-        drawable->draw(_wireframe);
-
-    return true;
-}
-
-void MayaViewer::fetchMessage() {
-	size_t messageLength = _comLib.nextSize();
-	if (messageLength > 0) {
-		char* msg = new char[messageLength];
-		if (_comLib.recv(msg, messageLength) == true) {
-			MessageHeader* header = (MessageHeader*)msg; //Remember that this is just a pointer to msg! It is deleted when msg is deleted.
-			if (header->type == MESH_ADDED) {
-				MeshMessage* meshInfo = (MeshMessage*)(msg + sizeof(MessageHeader));
-				std::vector<VertexMessage> vertices;
-				vertices.resize(meshInfo->vertexCount);
-				for (size_t i = 0; i < meshInfo->vertexCount; i++) {
-					vertices[i] = *(VertexMessage*)(msg + sizeof(MessageHeader) + sizeof(MeshMessage) + (sizeof(VertexMessage) * i));
-					//std::cout << "Positions: " << vertices[i].pos[0] << ", " << vertices[i].pos[1] << ", " << vertices[i].pos[2] << std::endl; //Debug
-					//std::cout << "Normals: " << vertices[i].normal[0] << ", " << vertices[i].normal[1] << ", " << vertices[i].normal[2] << std::endl;
-					//std::cout << "UVs: " << vertices[i].uv[0] << ", " << vertices[i].uv[1] << std::endl;
-				}
-				TransformMessage* transformInfo = (TransformMessage*)(msg + sizeof(MessageHeader) + sizeof(MeshMessage) + (sizeof(VertexMessage) * meshInfo->vertexCount));
-				Matrix* matrix = new Matrix();
-				matrix->set(transformInfo->transformationMatrix);
-				Vector3 translation, scale;
-				Quaternion rotationQuat;
-				matrix->decompose(&scale, &rotationQuat, &translation);
-				MaterialMessage* matInfo = (MaterialMessage*)(msg + sizeof(MessageHeader) + sizeof(MeshMessage) + (sizeof(VertexMessage) * meshInfo->vertexCount) + sizeof(TransformMessage));
-
-				addNewModel(meshInfo->name, vertices, matInfo);
-				updateTransform(translation, rotationQuat, scale, meshInfo->name);
-				std::cout << "A mesh with the name " << meshInfo->name << " was added!" << std::endl; //Debug
-				delete matrix;
+    updateLightUniforms();
+
+	//Everything visible is queued first so the opaque models can be drawn grouped by material and the blended ones back to front
+	_drawStatistics = DrawStatistics();
+	_opaqueDraws.clear();
+	_blendedDraws.clear();
+	_scene->visit(this, &MayaViewer::queueDraw);
+
+	std::sort(_opaqueDraws.begin(), _opaqueDraws.end(), [](const DrawItem& a, const DrawItem& b) {
+		return a.material != b.material ? a.material < b.material : a.vertexBuffer < b.vertexBuffer;
+	});
+	std::sort(_blendedDraws.begin(), _blendedDraws.end(), [](const DrawItem& a, const DrawItem& b) {
+		return a.depth < b.depth; //Looking down -z, the furthest is the most negative
+	});
+
+	Camera* camera = _scene->getActiveCamera();
+	_drawViewProjection = camera->getViewProjectionMatrix();
+	_drawView = camera->getViewMatrix();
+
+	Material* material = NULL;
+	VertexBufferHandle vertexBuffer = 0;
+	for (int blended = 0; blended < 2; blended++) {
+		std::vector<DrawItem>& draws = blended ? _blendedDraws : _opaqueDraws;
+		for (size_t i = 0; i < draws.size(); ) {
+			if (draws[i].material != material || draws[i].vertexBuffer != vertexBuffer) {
+				_drawStatistics.stateChanges++;
+				material = draws[i].material;
+				vertexBuffer = draws[i].vertexBuffer;
 			}
-			else if (header->type == MESH_REMOVED) {
-				MeshMessage* meshInfo = (MeshMessage*)(msg + sizeof(MessageHeader));
-				removeModel(meshInfo->name);
-				std::cout << "A mesh with the name " << meshInfo->name << " was removed!" << std::endl; //Debug
+
+			//The sort leaves the duplicates of a mesh next to each other, the blended draws keep their order instead
+			size_t count = 1;
+			while (!blended && i + count < draws.size() && canInstance(draws[i], draws[i + count])) {
+				count++;
 			}
-			else if (header->type == MESH_RENAMED) {
-				MeshMessage* meshInfo = (MeshMessage*)(msg + sizeof(MessageHeader));
-				renameModel(meshInfo->oldName, meshInfo->name);
-				std::cout << meshInfo->oldName << " was renamed to: " << meshInfo->name << std::endl; //Debug
+			if (count > 1) {
+				drawInstances(&draws[i], count);
 			}
-			else if(header->type == MESH_TRANSFORM_CHANGED){
-				MeshMessage* meshInfo = (MeshMessage*)(msg + sizeof(MessageHeader));
-				TransformMessage* transformInfo = (TransformMessage*)(msg + sizeof(MessageHeader) + sizeof(MeshMessage));
-				Matrix* matrix = new Matrix();
-				matrix->set(transformInfo->transformationMatrix);
-				Vector3 translation, scale;
-				Quaternion rotationQuat;
-				matrix->decompose(&scale, &rotationQuat, &translation);
-
-				updateTransform(translation, rotationQuat, scale, meshInfo->name);
-
-				//std::cout << "A mesh with the name " << meshInfo->name << " was transformed!" << std::endl; //Debug
-				delete matrix;
+			else {
+				drawItem(draws[i]);
 			}
-			else if (header->type == CAMERA_ADDED) {
-				CameraMessage* camInfo = (CameraMessage*)(msg + sizeof(MessageHeader));
-				//Create camera
-				if (camInfo->type == PERSPECTIVE_CAM) {
-					Camera* camera = Camera::createPerspective(MATH_RAD_TO_DEG(camInfo->FoV), getAspectRatio(), camInfo->nearPlane, camInfo->farPlane);
-					Node* cameraNode = _scene->addNode(camInfo->name);
-					cameraNode->setCamera(camera);
-					SAFE_RELEASE(camera);
-					//std::cout << "perspective camera created!" << std::endl; //Debug
-				}
-				else {
-					Camera* camera = Camera::createOrthographic(camInfo->viewWidth, camInfo->viewWidth / getAspectRatio(), getAspectRatio(), camInfo->nearPlane, camInfo->farPlane);
-					Node* cameraNode = _scene->addNode(camInfo->name);
-					cameraNode->setCamera(camera);
-					SAFE_RELEASE(camera);
-					//std::cout << "orthographic camera created!" << std::endl; //Debug
-				}
+			i += count;
+		}
+	}
+
+	_drawReportTime += elapsedTime / 1000.0f;
+	if (PRINT_DRAW_STATISTICS && _drawReportTime > DRAW_REPORT_INTERVAL) {
+		_drawReportTime = 0.0f;
+		if (_drawStatistics.drawCalls != _reportedDrawStatistics.drawCalls || _drawStatistics.stateChanges != _reportedDrawStatistics.stateChanges || _drawStatistics.culled != _reportedDrawStatistics.culled || _drawStatistics.instances != _reportedDrawStatistics.instances) {
+			std::cout << "Drawing: " << _drawStatistics.drawCalls << " draw calls, " << _drawStatistics.stateChanges << " state changes, " << _drawStatistics.culled << " models culled, " << _drawStatistics.instances << " drawn instanced" << std::endl; //Debug
+			_reportedDrawStatistics = _drawStatistics;
+		}
+	}
+}
+
+bool MayaViewer::queueDraw(Node* node) {
+	Model* model = dynamic_cast<Model*>(node->getDrawable());
+	if (!model) {
+		return true;
+	}
+
+	//The bounds are transformed here rather than taken from the node, which doesn't notice when an edit changes its mesh
+	bool skinned = isSkinned(model->getMesh());
+	Camera* camera = _scene->getActiveCamera();
+	BoundingSphere bounds(model->getMesh()->getBoundingSphere());
+	bounds.transform(node->getWorldMatrix());
+	if (!skinned && !bounds.intersects(camera->getFrustum())) { //A posed skin can reach outside the bounds of its bind pose
+		_drawStatistics.culled++;
+		return true;
+	}
+
+	unsigned int partCount = model->getMeshPartCount();
+	DrawItem item = { node, model, model->getMaterial(partCount > 0 ? 0 : -1), model->getMesh()->getVertexBuffer(), skinned ? findNodeSkin(node) : NULL, 0.0f };
+	bool blended = _blendedMaterials.count(item.material) > 0;
+	for (unsigned int i = 1; i < partCount && !blended; i++) {
+		blended = _blendedMaterials.count(model->getMaterial(i)) > 0;
+	}
+
+	if (blended) {
+		camera->getViewMatrix().transformPoint(&bounds.center);
+		item.depth = bounds.center.z;
+		_blendedDraws.push_back(item);
+	}
+	else {
+		_opaqueDraws.push_back(item);
+	}
+	return true;
+}
+
+void MayaViewer::drawItem(const DrawItem& item) {
+	//Materials are shared between models, so the values they point to are set for each draw
+	Node* node = item.node;
+	_drawWorldViewProjection = node->getWorldViewProjectionMatrix();
+	_drawWorldView = node->getWorldViewMatrix();
+	_drawInverseTransposeWorldView = node->getInverseTransposeWorldViewMatrix();
+	if (item.skin != NULL) {
+		std::copy(item.skin->matrixPalette.begin(), item.skin->matrixPalette.end(), _drawMatrixPalette);
+	}
+	item.model->draw(_wireframe);
+
+	unsigned int partCount = item.model->getMeshPartCount();
+	_drawStatistics.drawCalls += partCount > 0 ? partCount : 1;
+}
+
+bool MayaViewer::canInstance(const DrawItem& first, const DrawItem& item) const {
+	//Only duplicates share a mesh, and they are drawn together when every part has the same material
+	Model* model = first.model;
+	if (!_instancing || item.model->getMesh() != model->getMesh() || first.skin != NULL || item.skin != NULL) {
+		return false;
+	}
+	for (unsigned int i = 1; i < model->getMeshPartCount(); i++) {
+		if (item.model->getMaterial(i) != model->getMaterial(i)) {
+			return false;
+		}
+	}
+	return item.material == first.material;
+}
+
+void MayaViewer::drawInstances(const DrawItem* items, size_t count) {
+	//One model per shared mesh holds the instanced materials, the world matrices are uploaded next to the mesh and read per instance
+	Model* model = items[0].model;
+	Mesh* mesh = model->getMesh();
+	auto it = _instancedModels.find(mesh);
+	if (it == _instancedModels.end()) {
+		it = _instancedModels.insert(std::make_pair(mesh, Model::create(mesh))).first;
+	}
+	Model* instancedModel = it->second;
+
+	unsigned int partCount = model->getMeshPartCount();
+	for (unsigned int i = 0; i < (partCount > 0 ? partCount : 1); i++) {
+		int partIndex = i == 0 ? -1 : (int)i; //The first part uses the material of the model, like createModel sets it up
+		auto materialIt = _instancedMaterials.find(model->getMaterial(partCount > 0 ? (int)i : -1));
+		if (materialIt == _instancedMaterials.end()) { //Not a template of its own, only a placeholder would get here
+			for (size_t j = 0; j < count; j++) {
+				drawItem(items[j]);
 			}
-			else if (header->type == VIEW_CHANGED) {
-				CameraMessage* camInfo = (CameraMessage*)(msg + sizeof(MessageHeader));
-				Node* camNode = _scene->findNode(camInfo->name);
-				if (camNode) {
-					if (camInfo->type == ORTHOGRAPHIC_CAM) { //To get the zoom working correctly, create a new camera
-						Camera* camera = Camera::createOrthographic(camInfo->viewWidth, camInfo->viewWidth / getAspectRatio(), getAspectRatio(), camInfo->nearPlane, camInfo->farPlane);
-						camNode->setCamera(camera);
-						SAFE_RELEASE(camera);
-					}
-
-					_scene->setActiveCamera(camNode->getCamera());
-
-					Matrix* matrix = new Matrix();
-					matrix->set(camInfo->transformationMatrix);
-					Vector3 translation, scale;
-					Quaternion rotationQuat;
-					matrix->decompose(&scale, &rotationQuat, &translation);
-
-					camNode->setTranslation(translation);
-					camNode->setRotation(rotationQuat);
-
-					//std::cout << "Active camera is: " << camInfo->name << std::endl; //Debug
-					delete matrix;
+			return;
+		}
+		if (instancedModel->getMaterial(partIndex) != materialIt->second) {
+			instancedModel->setMaterial(materialIt->second, partIndex);
+		}
+	}
+
+	_instanceMatrices.clear();
+	for (size_t i = 0; i < count; i++) {
+		_instanceMatrices.push_back(items[i].node->getWorldMatrix());
+	}
+	mesh->setInstanceData(_instanceMatrices.data(), (unsigned int)count);
+	instancedModel->drawInstanced((unsigned int)count, _wireframe);
+
+	_drawStatistics.drawCalls += partCount > 0 ? partCount : 1;
+	_drawStatistics.instances += count;
+}
+
+const MayaViewer::SkinEntry* MayaViewer::findNodeSkin(Node* node) {
+	auto it = _nodeSkins.find(node);
+	if (it != _nodeSkins.end()) {
+		return it->second;
+	}
+
+	auto skinIt = _skins.find(node->getId());
+	const SkinEntry* skin = skinIt != _skins.end() ? &skinIt->second : NULL;
+	_nodeSkins[node] = skin;
+	return skin;
+}
+
+void MayaViewer::drainMessages() {
+	//Handles messages until either budget runs out, whatever is left waits until the next frame
+	//The ingest thread has already received and parsed them, only applying them to the scene is left for here
+	auto start = std::chrono::steady_clock::now();
+	size_t bytes = 0;
+	const MessageReceiver::Message* message = _receiver->front();
+	while (message != NULL) {
+		if (bytes > 0 && bytes + message->size > MESSAGE_BYTE_BUDGET) {
+			break; //A mesh that doesn't fit in what is left of the budget goes first next frame
+		}
+		applyMessage(*message);
+		bytes += message->size;
+		_receiver->pop();
+		if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(MESSAGE_TIME_BUDGET)) {
+			break;
+		}
+		message = _receiver->front();
+	}
+	flushPendingUpdates();
+	if (bytes > 0) {
+		_appliedBytes += bytes;
+		_applySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	_messageBacklog = _receiver->getBacklog();
+	if (_messageBacklog > 0) {
+		_backlogFrames++;
+		_peakMessageBacklog = _messageBacklog > _peakMessageBacklog ? _messageBacklog : _peakMessageBacklog;
+	}
+	else if (_backlogFrames > 0) {
+		if (PRINT_MESSAGE_STATISTICS) {
+			std::cout << "Caught up with a message backlog of up to " << (_peakMessageBacklog >> 10) << " KB after " << _backlogFrames << " frames" << std::endl; //Debug
+			printMessageStatistics();
+		}
+		_backlogFrames = 0;
+		_peakMessageBacklog = 0;
+	}
+}
+
+size_t MayaViewer::getMessageBacklog() const {
+	return _messageBacklog;
+}
+
+void MayaViewer::printMessageStatistics() {
+	//Throughput of the whole message path so far, receiving on the ingest thread and applying on the render thread
+	MessageReceiver::Statistics statistics = _receiver->getStatistics();
+	double megabytes = statistics.bytesReceived / (1024.0 * 1024.0);
+	std::cout << "Messages: " << statistics.messagesReceived << " (" << megabytes << " MB) received at "
+		<< (statistics.receiveSeconds > 0.0 ? megabytes / statistics.receiveSeconds : 0.0) << " MB/s, applied at "
+		<< (_applySeconds > 0.0 ? (_appliedBytes / (1024.0 * 1024.0)) / _applySeconds : 0.0) << " MB/s, "
+		<< statistics.dropped << " dropped, " << (statistics.peakQueuedBytes >> 10) << " KB peak queued" << std::endl; //Debug
+}
+
+void MayaViewer::applyMessage(const MessageReceiver::Message& message) {
+	char* msg = message.data; //Freed by the receiver once the message has been applied
+	MessageHeader* header = (MessageHeader*)msg;
+	if (header->type != TRANSFORM_CHANGED && header->type != VIEW_CHANGED) {
+		flushPendingUpdates(); //Everything else may add, rename or remove what the pending changes refer to
+	}
+
+	if (header->type == MESH_ADDED) {
+		MeshMessage* meshInfo = (MeshMessage*)(msg + sizeof(MessageHeader));
+		MeshPartMessage* parts = (MeshPartMessage*)(msg + sizeof(MessageHeader) + sizeof(MeshMessage));
+		VertexMessage* vertices = (VertexMessage*)(parts + meshInfo->partCount); //Uploaded straight from the received message
+		TransformMessage* transformInfo = (TransformMessage*)(vertices + meshInfo->vertexCount);
+
+		updateTransform(transformInfo); //The transform has to exist before the mesh can be attached to it
+		addNewModel(meshInfo->name, meshInfo->parentName, vertices, meshInfo->vertexCount, parts, meshInfo->partCount, meshInfo->contentHash, meshInfo->duplicate);
+		std::cout << "A mesh with the name " << meshInfo->name << " was added!" << std::endl; //Debug
+	}
+	else if (header->type == MESH_REMOVED) {
+		MeshMessage* meshInfo = (MeshMessage*)(msg + sizeof(MessageHeader));
+		removeModel(meshInfo->name);
+		std::cout << "A mesh with the name " << meshInfo->name << " was removed!" << std::endl; //Debug
+	}
+	else if (header->type == MESH_RENAMED) {
+		MeshMessage* meshInfo = (MeshMessage*)(msg + sizeof(MessageHeader));
+		renameModel(meshInfo->oldName, meshInfo->name);
+		std::cout << meshInfo->oldName << " was renamed to: " << meshInfo->name << std::endl; //Debug
+	}
+	else if(header->type == TRANSFORM_CHANGED){
+		TransformMessage* transformInfo = (TransformMessage*)(msg + sizeof(MessageHeader));
+		queueTransform(transformInfo);
+
+		//std::cout << "The transform " << transformInfo->name << " was changed!" << std::endl; //Debug
+	}
+	else if (header->type == TRANSFORM_REMOVED) {
+		TransformMessage* transformInfo = (TransformMessage*)(msg + sizeof(MessageHeader));
+		removeTransform(transformInfo->name);
+	}
+	else if (header->type == TRANSFORM_RENAMED) {
+		TransformMessage* transformInfo = (TransformMessage*)(msg + sizeof(MessageHeader));
+		renameModel(transformInfo->oldName, transformInfo->name); //Works on any node in the scene
+	}
+	else if (header->type == CAMERA_ADDED) {
+		CameraMessage* camInfo = (CameraMessage*)(msg + sizeof(MessageHeader));
+		addCamera(camInfo);
+	}
+	else if (header->type == VIEW_CHANGED) {
+		CameraMessage* camInfo = (CameraMessage*)(msg + sizeof(MessageHeader));
+		queueView(camInfo, message.viewTranslation, message.viewRotation);
+	}
+	else if (header->type == MATERIAL_CHANGED) {
+		MeshMessage* meshInfo = (MeshMessage*)(msg + sizeof(MessageHeader));
+		changeMaterial(meshInfo->name, meshInfo->materialName);
+	}
+	else if (header->type == MATERIAL_DEFINED || header->type == MATERIAL_UPDATED) {
+		MaterialMessage* matInfo = (MaterialMessage*)(msg + sizeof(MessageHeader));
+		defineMaterial(matInfo);
+	}
+	else if (header->type == MATERIAL_RENAMED) {
+		MaterialMessage* matInfo = (MaterialMessage*)(msg + sizeof(MessageHeader));
+		renameMaterial(matInfo->oldName, matInfo->name);
+	}
+	else if (header->type == LIGHT_ADDED || header->type == LIGHT_CHANGED) {
+		LightMessage* lightInfo = (LightMessage*)(msg + sizeof(MessageHeader));
+		updateLight(lightInfo);
+	}
+	else if (header->type == LIGHT_REMOVED) {
+		LightMessage* lightInfo = (LightMessage*)(msg + sizeof(MessageHeader));
+		removeLight(lightInfo->name);
+	}
+	else if (header->type == LIGHT_RENAMED) {
+		LightMessage* lightInfo = (LightMessage*)(msg + sizeof(MessageHeader));
+		renameModel(lightInfo->oldName, lightInfo->name); //Works on any node in the scene
+	}
+	else if (header->type == MESH_TOPOLOGY_CHANGED) {
+		MeshMessage* meshInfo = (MeshMessage*)(msg + sizeof(MessageHeader));
+		MeshPartMessage* parts = (MeshPartMessage*)(msg + sizeof(MessageHeader) + sizeof(MeshMessage));
+		VertexMessage* vertices = (VertexMessage*)(parts + meshInfo->partCount);
+		updateModel(meshInfo->name, vertices, meshInfo->vertexCount, parts, meshInfo->partCount, meshInfo->contentHash);
+	}
+	else if (header->type == SCENE_SNAPSHOT) {
+		loadSnapshot(msg + sizeof(MessageHeader));
+	}
+	else if (header->type == HASHES_REQUESTED) {
+		sendContentHashes();
+	}
+	else if (header->type == SKIN_BOUND) {
+		SkinMessage* skinInfo = (SkinMessage*)(msg + sizeof(MessageHeader));
+		JointMessage* joints = (JointMessage*)(msg + sizeof(MessageHeader) + sizeof(SkinMessage));
+		SkinWeightMessage* weights = (SkinWeightMessage*)(joints + skinInfo->jointCount);
+		JointPoseMessage* poses = (JointPoseMessage*)(weights + skinInfo->vertexCount);
+		bindSkin(skinInfo, joints, weights, poses);
+	}
+	else if (header->type == SKIN_POSED) {
+		SkinMessage* skinInfo = (SkinMessage*)(msg + sizeof(MessageHeader));
+		poseSkin(skinInfo, (JointPoseMessage*)(msg + sizeof(MessageHeader) + sizeof(SkinMessage)));
+	}
+	else if (header->type == CLIP) {
+		loadClip(msg + sizeof(MessageHeader), message.size - sizeof(MessageHeader));
+	}
+}
+
+void MayaViewer::queueTransform(TransformMessage* transformInfo) {
+	//Dragging in Maya sends a change per move, only the latest one of each transform is applied
+	auto it = _pendingTransformIndices.find(transformInfo->name);
+	if (it != _pendingTransformIndices.end()) {
+		_pendingTransforms[it->second] = *transformInfo;
+	}
+	else {
+		_pendingTransformIndices[transformInfo->name] = _pendingTransforms.size();
+		_pendingTransforms.push_back(*transformInfo);
+	}
+}
+
+void MayaViewer::queueView(CameraMessage* camInfo, const Vector3& translation, const Quaternion& rotation) {
+	for (size_t i = 0; i < _pendingViews.size(); i++) {
+		if (strcmp(_pendingViews[i].info.name, camInfo->name) == 0) {
+			_pendingViews.erase(_pendingViews.begin() + i); //Moved last so the camera that changed last stays active
+			break;
+		}
+	}
+	_pendingViews.push_back({ *camInfo, translation, rotation });
+}
+
+void MayaViewer::flushPendingUpdates() {
+	for (size_t i = 0; i < _pendingTransforms.size(); i++) {
+		updateTransform(&_pendingTransforms[i]);
+	}
+	for (size_t i = 0; i < _pendingViews.size(); i++) {
+		changeView(&_pendingViews[i].info, _pendingViews[i].translation, _pendingViews[i].rotation);
+	}
+	_pendingTransforms.clear();
+	_pendingTransformIndices.clear();
+	_pendingViews.clear();
+}
+
+void MayaViewer::changeView(CameraMessage* camInfo, const Vector3& translation, const Quaternion& rotation) {
+	Node* camNode = findNode(camInfo->name);
+	if (camNode) {
+		if (camInfo->type == ORTHOGRAPHIC_CAM) { //To get the zoom working correctly, create a new camera
+			Camera* camera = Camera::createOrthographic(camInfo->viewWidth, camInfo->viewWidth / getAspectRatio(), getAspectRatio(), camInfo->nearPlane, camInfo->farPlane);
+			camNode->setCamera(camera);
+			SAFE_RELEASE(camera);
+		}
+
+		_scene->setActiveCamera(camNode->getCamera());
+		camNode->setTranslation(translation);
+		camNode->setRotation(rotation);
+
+		//std::cout << "Active camera is: " << camInfo->name << std::endl; //Debug
+	}
+}
+
+void MayaViewer::loadSnapshot(char* snapshot) {
+	//Every section of the snapshot is contiguous, so they are walked with one pointer each instead of being copied
+	SceneSnapshotMessage* snapshotInfo = (SceneSnapshotMessage*)snapshot;
+	CameraMessage* cameras = (CameraMessage*)(snapshot + sizeof(SceneSnapshotMessage));
+	MaterialMessage* materials = (MaterialMessage*)(cameras + snapshotInfo->cameraCount);
+	TransformMessage* transforms = (TransformMessage*)(materials + snapshotInfo->materialCount);
+	LightMessage* lights = (LightMessage*)(transforms + snapshotInfo->transformCount);
+	MeshMessage* meshes = (MeshMessage*)(lights + snapshotInfo->lightCount);
+	MeshPartMessage* parts = (MeshPartMessage*)(meshes + snapshotInfo->meshCount);
+	VertexMessage* vertices = (VertexMessage*)(parts + snapshotInfo->partCount);
+
+	for (size_t i = 0; i < snapshotInfo->cameraCount; i++) {
+		addCamera(&cameras[i]);
+	}
+
+	for (size_t i = 0; i < snapshotInfo->materialCount; i++) {
+		defineMaterial(&materials[i]);
+	}
+
+	for (size_t i = 0; i < snapshotInfo->transformCount; i++) { //Parents come before their children
+		updateTransform(&transforms[i]);
+	}
+
+	for (size_t i = 0; i < snapshotInfo->lightCount; i++) {
+		updateLight(&lights[i]);
+	}
+
+	_nodes.reserve(_nodes.size() + snapshotInfo->transformCount + snapshotInfo->meshCount);
+	_models.reserve(_models.size() + snapshotInfo->meshCount);
+	for (size_t i = 0; i < snapshotInfo->meshCount; i++) {
+		addNewModel(meshes[i].name, meshes[i].parentName, vertices, meshes[i].vertexCount, parts, meshes[i].partCount, meshes[i].contentHash, meshes[i].duplicate);
+		parts += meshes[i].partCount;
+		vertices += meshes[i].vertexCount;
+	}
+
+	std::cout << "Scene snapshot with " << snapshotInfo->meshCount << " meshes, " << snapshotInfo->materialCount << " materials, " << snapshotInfo->transformCount << " transforms, " << snapshotInfo->lightCount << " lights and " << snapshotInfo->cameraCount << " cameras was loaded!" << std::endl; //Debug
+}
+
+void MayaViewer::sendContentHashes() {
+	MessageType type = CONTENT_HASHES;
+	ContentHashesMessage hashesInfo;
+	hashesInfo.meshCount = _meshHashes.size();
+	hashesInfo.materialCount = _materials.size();
+
+	//Create and send message
+	size_t msgSize = sizeof(MessageType) + sizeof(ContentHashesMessage) + sizeof(ContentHashMessage) * (hashesInfo.meshCount + hashesInfo.materialCount);
+	char* msg = new char[msgSize];
+	memcpy(msg, &type, sizeof(MessageType));
+	memcpy(msg + sizeof(MessageType), &hashesInfo, sizeof(ContentHashesMessage));
+
+	ContentHashMessage* hashes = (ContentHashMessage*)(msg + sizeof(MessageType) + sizeof(ContentHashesMessage));
+	for (auto& it : _meshHashes) {
+		strncpy(hashes->name, it.first.c_str(), NAME_SIZE - 1);
+		hashes->name[NAME_SIZE - 1] = '\0';
+		hashes->contentHash = it.second;
+		hashes++;
+	}
+	for (auto& it : _materials) {
+		strncpy(hashes->name, it.first.c_str(), NAME_SIZE - 1);
+		hashes->name[NAME_SIZE - 1] = '\0';
+		hashes->contentHash = it.second.contentHash;
+		hashes++;
+	}
+
+	if (_viewerComLib.send(msg, msgSize) == false) {
+		std::cout << "The content hashes could not be sent to the plugin" << std::endl; //Debug
+	}
+	delete[] msg;
+}
+
+void MayaViewer::requestClip() {
+	MessageType type = CLIP_REQUESTED;
+	if (_viewerComLib.send(&type, sizeof(MessageType)) == false) {
+		std::cout << "The clip could not be requested from the plugin" << std::endl; //Debug
+	}
+}
+
+void MayaViewer::requestMesh(const char* meshName) {
+	MessageType type = MESH_REQUESTED;
+	MeshMessage meshInfo;
+	strncpy(meshInfo.name, meshName, NAME_SIZE - 1);
+
+	char msg[sizeof(MessageType) + sizeof(MeshMessage)];
+	memcpy(msg, &type, sizeof(MessageType));
+	memcpy(msg + sizeof(MessageType), &meshInfo, sizeof(MeshMessage));
+	if (_viewerComLib.send(msg, sizeof(msg)) == false) {
+		std::cout << "The mesh " << meshName << " could not be requested from the plugin" << std::endl; //Debug
+	}
+}
+
+void MayaViewer::loadClip(char* clip, size_t clipSize) {
+	ClipMessage* clipInfo = (ClipMessage*)clip;
+	ClipTrackMessage* trackInfos = (ClipTrackMessage*)(clip + sizeof(ClipMessage));
+	const unsigned char* data = (const unsigned char*)(trackInfos + clipInfo->trackCount);
+	const unsigned char* end = (const unsigned char*)clip + clipSize;
+
+	_clipTracks.clear();
+	_clipTracks.resize(clipInfo->trackCount);
+	for (size_t i = 0; i < clipInfo->trackCount; i++) {
+		ClipTrack& track = _clipTracks[i];
+		track.name = trackInfos[i].name;
+		track.type = trackInfos[i].type;
+		track.channelCount = trackInfos[i].channelCount;
+		size_t requiredChannels = track.type == TRANSFORM_TRACK ? 10 : (track.type == CAMERA_TRACK ? 7 : 0); //What applyClipFrame reads of them
+
+		//The sizes are compared before any pointer is moved, so a huge size can't wrap around
+		size_t dataSize = trackInfos[i].dataSize;
+		size_t vertexCount = trackInfos[i].vertexCount;
+		bool fits = dataSize <= (size_t)(end - data) && vertexCount <= dataSize / (sizeof(VertexMessage) + sizeof(unsigned int));
+		const unsigned char* trackEnd = fits ? data + dataSize : NULL;
+		size_t verticesSize = sizeof(VertexMessage) * vertexCount;
+		size_t indicesSize = sizeof(unsigned int) * vertexCount;
+		bool validChannels = track.channelCount >= requiredChannels && track.channelCount <= (dataSize - verticesSize - indicesSize) / (sizeof(float) * 2); //Every channel starts with its minimum and step
+		const unsigned char* channel = fits && validChannels ? data + verticesSize + indicesSize : NULL;
+		if (channel != NULL && vertexCount > 0) {
+			track.vertices.assign((const VertexMessage*)data, (const VertexMessage*)data + vertexCount);
+			track.pointIndices.assign((const unsigned int*)(data + verticesSize), (const unsigned int*)(data + verticesSize) + vertexCount);
+			for (size_t j = 0; j < vertexCount; j++) {
+				if (track.pointIndices[j] >= track.channelCount / 3) { //applyClipFrame reads three channels per point
+					channel = NULL;
+					break;
 				}
 			}
-			else if (header->type == MATERIAL_CHANGED) {
-				MeshMessage* meshInfo = (MeshMessage*)(msg + sizeof(MessageHeader));
-				MaterialMessage* matInfo = (MaterialMessage*)(msg + sizeof(MessageHeader) + sizeof(MeshMessage));
+		}
+
+		if (channel != NULL) {
+			track.samples.resize(track.channelCount * clipInfo->frameCount);
+		}
+		for (size_t j = 0; j < track.channelCount && channel != NULL; j++) {
+			channel = decodeChannel(channel, trackEnd, clipInfo->frameCount, &track.samples[j], track.channelCount);
+		}
+		if (channel == NULL) {
+			std::cout << "The clip is damaged and can't be played" << std::endl; //Debug
+			_clipTracks.clear();
+			return;
+		}
+		data = trackEnd;
+
+		Node* node = findNode(track.name.c_str());
+		if (track.type == CAMERA_TRACK && node && node->getCamera()) { //Played from the camera Maya was looking through
+			_scene->setActiveCamera(node->getCamera());
+		}
+	}
+
+	_clipFrameCount = clipInfo->frameCount;
+	_clipFrameRate = clipInfo->frameRate;
+	_clipCurrentFrame = clipInfo->currentFrame;
+	_clipTime = 0.0f;
+	_clipPlaying = _clipFrameCount > 0;
+	std::cout << "Playing a clip of " << _clipFrameCount << " frames with " << _clipTracks.size() << " tracks" << std::endl; //Debug
+}
+
+void MayaViewer::playClip(float elapsedTime) {
+	_clipTime += elapsedTime / 1000.0f * _clipFrameRate;
+	_clipTime = fmodf(_clipTime, (float)_clipFrameCount); //Loops like Maya's playback
+	applyClipFrame(_clipTime);
+}
+
+void MayaViewer::applyClipFrame(float frame) {
+	size_t first = (size_t)frame;
+	size_t second = first + 1 < _clipFrameCount ? first + 1 : first;
+	float blend = frame - first;
+
+	std::vector<float> values;
+	for (size_t i = 0; i < _clipTracks.size(); i++) {
+		ClipTrack& track = _clipTracks[i];
+		Node* node = findNode(track.name.c_str());
+		if (!node) {
+			continue;
+		}
 
-				changeMaterial(meshInfo->name, matInfo);
+		const float* a = &track.samples[first * track.channelCount];
+		const float* b = &track.samples[second * track.channelCount];
+		values.resize(track.channelCount);
+		for (size_t j = 0; j < track.channelCount; j++) {
+			values[j] = a[j] + (b[j] - a[j]) * blend;
+		}
+
+		if (track.type == TRANSFORM_TRACK || track.type == CAMERA_TRACK) {
+			Quaternion rotation;
+			Quaternion::slerp(Quaternion(a[3], a[4], a[5], a[6]), Quaternion(b[3], b[4], b[5], b[6]), blend, &rotation);
+			node->setTranslation(values[0], values[1], values[2]);
+			node->setRotation(rotation);
+			if (track.type == TRANSFORM_TRACK) {
+				node->setScale(values[7], values[8], values[9]);
 			}
-			else if (header->type == MESH_TOPOLOGY_CHANGED) {
-				MeshMessage* meshInfo = (MeshMessage*)(msg + sizeof(MessageHeader));
-				std::vector<VertexMessage> vertices;
-				vertices.resize(meshInfo->vertexCount);
-				for (size_t i = 0; i < meshInfo->vertexCount; i++) {
-					vertices[i] = *(VertexMessage*)(msg + sizeof(MessageHeader) + sizeof(MeshMessage) + (sizeof(VertexMessage) * i));
-				}
-				updateModel(meshInfo->name, vertices);
+		}
+		else if (track.type == SKIN_TRACK) {
+			SkinMessage skinInfo;
+			strncpy(skinInfo.meshName, track.name.c_str(), NAME_SIZE - 1);
+			skinInfo.jointCount = track.channelCount / 16;
+			poseSkin(&skinInfo, (JointPoseMessage*)values.data());
+		}
+		else if (track.type == POINTS_TRACK) {
+			Model* model = dynamic_cast<Model*>(node->getDrawable());
+			Mesh* mesh = model ? model->getMesh() : NULL;
+			auto modelIt = _models.find(track.name);
+			if (!mesh || modelIt == _models.end() || modelIt->second.vertexCount != track.vertices.size() || mesh->getVertexSize() != sizeof(VertexMessage)) { //Changed since the clip was baked
+				continue;
 			}
-
-			delete msg; //Header and message gets deleted
+			auto sharedIt = _sharedMeshes.find(modelIt->second.sharedHash);
+			if (modelIt->second.sharedHash != 0 && sharedIt != _sharedMeshes.end() && sharedIt->second.users > 1) { //The duplicates keep their points, this one moves them in a mesh of its own
+				std::vector<MeshPartMessage> parts = modelIt->second.parts;
+				model = createModel(track.name.c_str(), track.vertices.data(), track.vertices.size(), parts.data(), parts.size(), NULL, mesh);
+				node->setDrawable(model);
+				SAFE_RELEASE(model);
+				model = dynamic_cast<Model*>(node->getDrawable());
+				mesh = model->getMesh();
+			}
+			releaseSharedMesh(modelIt->second); //A mesh with no other user is moved where it is, it just no longer matches its hash
+			for (size_t j = 0; j < track.vertices.size(); j++) {
+				const float* point = &values[track.pointIndices[j] * 3];
+				track.vertices[j].pos[0] = point[0];
+				track.vertices[j].pos[1] = point[1];
+				track.vertices[j].pos[2] = point[2];
+			}
+			mesh->setVertexData(track.vertices.data(), 0, track.vertices.size());
+			setMeshBounds(mesh, track.vertices.data(), track.vertices.size());
 		}
 	}
 }
 
+void MayaViewer::stopClip() {
+	if (_clipFrameCount > 0) {
+		applyClipFrame((float)_clipCurrentFrame); //Back to what Maya shows
+	}
+	_clipTracks.clear();
+	_clipPlaying = false;
+}
+
 void MayaViewer::keyEvent(Keyboard::KeyEvent evt, int key) {
     if (evt == Keyboard::KEY_PRESS) {
 		gKeys[key] = true;
@@ -204,6 +730,14 @@ void MayaViewer::keyEvent(Keyboard::KeyEvent evt, int key) {
         case Keyboard::KEY_ESCAPE:
             exit();
             break;
+		case Keyboard::KEY_P: //Plays Maya's playback range, pressed again it stops
+			if (_clipPlaying) {
+				stopClip();
+			}
+			else {
+				requestClip();
+			}
+			break;
 		};
     }
 	else if (evt == Keyboard::KEY_RELEASE){
@@ -225,191 +759,604 @@ bool MayaViewer::mouseEvent(Mouse::MouseEvent evt, int x, int y, int wheelDelta)
 	return true;
 }
 
-void MayaViewer::addNewModel(const char* modelName, std::vector<VertexMessage>& vertices, MaterialMessage* matInfo) {
-	Mesh* mesh2 = createMesh(vertices);
-	Model* tempModel = Model::create(mesh2);
-
-	if (strcmp(matInfo->diffuseTexPath, "") != 0) {
-		//Textured
-		Material* tempMaterial;
-		if (matInfo->specularPower > 0.0f) {
-			tempMaterial = tempModel->setMaterial("res/shaders/textured.vert", "res/shaders/textured.frag", "POINT_LIGHT_COUNT 1;SPECULAR");
+void MayaViewer::addNewModel(const char* modelName, const char* parentName, const VertexMessage* vertices, size_t vertexCount, const MeshPartMessage* parts, size_t partCount, unsigned long long contentHash, bool duplicate) {
+	//A duplicate comes without vertices, if the mesh it duplicates was edited or removed since, the plugin is asked for them
+	bool missing = duplicate && _sharedMeshes.find(contentHash) == _sharedMeshes.end();
+	Node* node = findNode(modelName);
+	if (node && node->getDrawable()) { //Still here from before the plugin was reloaded
+		auto it = _meshHashes.find(modelName);
+		if (missing && (it == _meshHashes.end() || it->second != contentHash)) {
+			requestMesh(modelName); //The old model is drawn until the vertices arrive
 		}
-		else {
-			tempMaterial = tempModel->setMaterial("res/shaders/textured.vert", "res/shaders/textured.frag", "POINT_LIGHT_COUNT 1");
+		else if (it == _meshHashes.end() || it->second != contentHash) { //The hash covers the materials of the parts as well
+			releaseSharedMesh(_models[modelName]); //The model still holds the old mesh until it is replaced
+			Model* model = createOrShareModel(modelName, vertices, vertexCount, parts, partCount, contentHash);
+			node->setDrawable(model);
+			SAFE_RELEASE(model);
+			_meshHashes[modelName] = contentHash;
 		}
-		Texture::Sampler* tempSampler = tempMaterial->getParameter("u_diffuseTexture")->setValue(matInfo->diffuseTexPath, true);
-
-		tempMaterial->setParameterAutoBinding("u_worldViewProjectionMatrix", "WORLD_VIEW_PROJECTION_MATRIX");
-		tempMaterial->setParameterAutoBinding("u_inverseTransposeWorldViewMatrix", "INVERSE_TRANSPOSE_WORLD_VIEW_MATRIX");
-		tempMaterial->getParameter("u_ambientColor")->setValue(Vector3(0.1f, 0.1f, 0.2f));
-		tempMaterial->getParameter("u_pointLightColor[0]")->setValue(_defaultLight->getLight()->getColor());
-		tempMaterial->getParameter("u_pointLightPosition[0]")->bindValue(_defaultLight, &Node::getTranslationWorld);
-		tempMaterial->getParameter("u_pointLightRangeInverse[0]")->bindValue(_defaultLight->getLight(), &Light::getRangeInverse);
-
-		tempMaterial->getParameter("u_specularExponent")->setValue(matInfo->specularPower);
-		tempMaterial->setParameterAutoBinding("u_cameraPosition", "CAMERA_WORLD_POSITION");
-
-		tempSampler->setFilterMode(Texture::LINEAR_MIPMAP_LINEAR, Texture::LINEAR);
-
-		tempMaterial->getStateBlock()->setCullFace(true);
-		tempMaterial->getStateBlock()->setDepthTest(true);
-		tempMaterial->getStateBlock()->setDepthWrite(true);
-
-		tempMaterial->getStateBlock()->setBlend(true);
-		tempMaterial->getStateBlock()->setBlendSrc(RenderState::BLEND_SRC_ALPHA);
-		tempMaterial->getStateBlock()->setBlendDst(RenderState::BLEND_ONE_MINUS_SRC_ALPHA);
-	}
-	else {
-		//Colored
-		Material* tempMaterial;
-		if (matInfo->specularPower > 0.0f) {
-			tempMaterial = tempModel->setMaterial("res/shaders/colored.vert", "res/shaders/colored.frag", "POINT_LIGHT_COUNT 1;SPECULAR");
-		}
-		else {
-			tempMaterial = tempModel->setMaterial("res/shaders/colored.vert", "res/shaders/colored.frag", "POINT_LIGHT_COUNT 1");
+		Node* parent = findOrCreateTransform(parentName);
+		if (node->getParent() != parent) {
+			parent->addChild(node);
 		}
-		
-		tempMaterial->setParameterAutoBinding("u_worldViewProjectionMatrix", "WORLD_VIEW_PROJECTION_MATRIX");
-		tempMaterial->setParameterAutoBinding("u_inverseTransposeWorldViewMatrix", "INVERSE_TRANSPOSE_WORLD_VIEW_MATRIX");
-		tempMaterial->getParameter("u_diffuseColor")->setValue(Vector4(matInfo->color[0], matInfo->color[1], matInfo->color[2], 1.0f));
-		tempMaterial->getParameter("u_ambientColor")->setValue(Vector3(0.1f, 0.1f, 0.2f));
-		tempMaterial->getParameter("u_pointLightColor[0]")->setValue(_defaultLight->getLight()->getColor());
-		tempMaterial->getParameter("u_pointLightPosition[0]")->bindValue(_defaultLight, &Node::getTranslationWorld);
-		tempMaterial->getParameter("u_pointLightRangeInverse[0]")->bindValue(_defaultLight->getLight(), &Light::getRangeInverse);
-
-		tempMaterial->getParameter("u_specularExponent")->setValue(matInfo->specularPower);
-		tempMaterial->setParameterAutoBinding("u_cameraPosition", "CAMERA_WORLD_POSITION");
-
-		tempMaterial->getStateBlock()->setCullFace(true);
-		tempMaterial->getStateBlock()->setDepthTest(true);
-		tempMaterial->getStateBlock()->setDepthWrite(true);
+		return;
+	}
+	if (missing) {
+		requestMesh(modelName);
+		return;
 	}
 
-	Node* node = _scene->addNode(modelName);
+	Model* tempModel = createOrShareModel(modelName, vertices, vertexCount, parts, partCount, contentHash);
+
+	node = Node::create(modelName); //The mesh follows its transform through the node hierarchy
 	node->setDrawable(tempModel);
+	registerNode(node);
+	findOrCreateTransform(parentName)->addChild(node);
+	SAFE_RELEASE(node);
 	SAFE_RELEASE(tempModel);
 	_modelCount += 1;
 	//_materialCount += 1;
-	_modelnames.push_back(modelName);
-	//_materialNames.push_back(matInfo->name);
+	_meshHashes[modelName] = contentHash;
+}
+
+void MayaViewer::addCamera(CameraMessage* camInfo) {
+	if (camInfo->type == PERSPECTIVE_CAM) {
+		Camera* camera = Camera::createPerspective(MATH_RAD_TO_DEG(camInfo->FoV), getAspectRatio(), camInfo->nearPlane, camInfo->farPlane);
+		Node* cameraNode = _scene->addNode(camInfo->name);
+		cameraNode->setCamera(camera);
+		registerNode(cameraNode);
+		SAFE_RELEASE(camera);
+		//std::cout << "perspective camera created!" << std::endl; //Debug
+	}
+	else {
+		Camera* camera = Camera::createOrthographic(camInfo->viewWidth, camInfo->viewWidth / getAspectRatio(), getAspectRatio(), camInfo->nearPlane, camInfo->farPlane);
+		Node* cameraNode = _scene->addNode(camInfo->name);
+		cameraNode->setCamera(camera);
+		registerNode(cameraNode);
+		SAFE_RELEASE(camera);
+		//std::cout << "orthographic camera created!" << std::endl; //Debug
+	}
 }
 
 void MayaViewer::removeModel(const char* modelName) {
-	Node* node = _scene->findNode(modelName);
+	Node* node = findNode(modelName);
 	if (node) {
-		_scene->removeNode(node);
-		auto it = std::find(_modelnames.begin(), _modelnames.end(), modelName);
-		if (it != _modelnames.end()) {
-			swap(*it, _modelnames.back());
-			_modelnames.pop_back();
-		}
+		detachNode(node);
 		_modelCount -= 1;
+		_meshHashes.erase(modelName);
+		_skins.erase(modelName);
+		_nodeSkins.clear();
+		_models.erase(modelName);
+	}
+}
+
+void MayaViewer::removeTransform(const char* transformName) {
+	Node* node = findNode(transformName);
+	if (node && node->getDrawable() == NULL && node->getCamera() == NULL) { //Maya removes the children of a transform before the transform itself
+		detachNode(node);
 	}
 }
 
 void MayaViewer::renameModel(const char* oldName, const char* newName) {
-	Node* node = _scene->findNode(oldName);
+	Node* node = findNode(oldName);
 	if (node) {
+		_nodes.erase(oldName);
 		node->setId(newName);
-		auto it = std::find(_modelnames.begin(), _modelnames.end(), oldName);
-		if (it != _modelnames.end()) {
-			swap(*it, _modelnames.back());
-			_modelnames.pop_back();
-			_modelnames.push_back(newName);
+		registerNode(node);
+
+		auto hashIt = _meshHashes.find(oldName);
+		if (hashIt != _meshHashes.end()) {
+			unsigned long long contentHash = hashIt->second;
+			_meshHashes.erase(hashIt);
+			_meshHashes[newName] = contentHash;
+		}
+
+		auto skinIt = _skins.find(oldName);
+		if (skinIt != _skins.end()) {
+			SkinEntry skin = skinIt->second;
+			_skins.erase(skinIt);
+			_skins[newName] = skin;
+			_nodeSkins.clear();
+		}
+
+		auto modelIt = _models.find(oldName);
+		if (modelIt != _models.end()) {
+			ModelEntry entry = modelIt->second;
+			_models.erase(modelIt);
+			_models[newName] = entry;
 		}
 	}
 }
 
-void MayaViewer::updateModel(const char* modelName, std::vector<VertexMessage>& vertices) {
-	Node* node = _scene->findNode(modelName);
+void MayaViewer::updateModel(const char* modelName, const VertexMessage* vertices, size_t vertexCount, const MeshPartMessage* parts, size_t partCount, unsigned long long contentHash) {
+	Node* node = findNode(modelName);
 	if (node) {
-		Model* oldModel = (Model*)node->getDrawable();
-		Material* material = oldModel->getMaterial();
+		auto skinIt = _skins.find(modelName);
+		const SkinEntry* skin = skinIt != _skins.end() ? &skinIt->second : NULL;
+		bool skinned = skin != NULL && skin->weights.size() == vertexCount && vertexCount > 0;
+		Model* model = dynamic_cast<Model*>(node->getDrawable());
+		Mesh* mesh = model ? model->getMesh() : NULL;
+		auto modelIt = _models.find(modelName);
 
-		Mesh* mesh = createMesh(vertices);
-		Model* newModel = Model::create(mesh);
-		newModel->setMaterial(material);
+		//While the vertices and parts fit, an edit is only an upload into the buffers the mesh already has
+		bool fits = mesh && modelIt != _models.end() && mesh->isDynamic() && vertexCount <= mesh->getVertexCount()
+			&& isSkinned(mesh) == skinned && mesh->getPartCount() == (partCount > 1 ? partCount : 0);
+		for (size_t i = 0; fits && i < mesh->getPartCount(); i++) {
+			fits = parts[i].vertexCount <= mesh->getPart((unsigned int)i)->getIndexCount();
+		}
 
-		node->setDrawable(newModel);
-		SAFE_RELEASE(newModel);
+		if (fits) {
+			writeVertices(mesh, vertices, skinned ? skin->weights.data() : NULL, vertexCount, modelIt->second.vertexCount);
+			writeParts(mesh, parts, partCount);
+			setModelMaterials(modelName, model, parts, partCount, skinned); //The parts carry the materials, which can have changed as well
+			modelIt->second.vertexCount = vertexCount;
+		}
+		else {
+			releaseSharedMesh(_models[modelName]); //An edited mesh is no longer a duplicate
+			Model* newModel = createModel(modelName, vertices, vertexCount, parts, partCount, skin, mesh);
+			node->setDrawable(newModel);
+			SAFE_RELEASE(newModel);
+		}
+		_meshHashes[modelName] = contentHash;
 	}
 }
 
+void MayaViewer::defineMaterial(MaterialMessage* matInfo) {
+	std::string templateKey = getTemplateKey(matInfo);
+	auto it = _materials.find(matInfo->name);
+	if (it == _materials.end()) {
+		acquireTemplate(templateKey, matInfo);
+	}
+	else if (it->second.templateKey != templateKey) {
+		auto templateIt = _materialTemplates.find(it->second.templateKey);
+		MaterialTemplate& materialTemplate = templateIt->second;
+		bool textured = strcmp(matInfo->diffuseTexPath, "") != 0;
+		bool sameShader = textured == (strcmp(materialTemplate.info.diffuseTexPath, "") != 0) && (matInfo->specularPower > 0.0f) == (materialTemplate.info.specularPower > 0.0f);
+		if (materialTemplate.users == 1 && sameShader && _materialTemplates.find(templateKey) == _materialTemplates.end()) {
+			//Nothing else looks like this material, so the values are changed in place and nothing is recompiled
+			if (textured) { //Before the old file is released, so an unchanged texture is never dropped in between
+				_textures->acquire(matInfo->diffuseTexPath);
+				_textures->release(materialTemplate.info.diffuseTexPath);
+			}
+			setMaterialValues(materialTemplate.material, matInfo);
+			if (materialTemplate.skinnedMaterial) {
+				setMaterialValues(materialTemplate.skinnedMaterial, matInfo);
+			}
+			if (materialTemplate.instancedMaterial) {
+				setMaterialValues(materialTemplate.instancedMaterial, matInfo);
+			}
+			materialTemplate.info = *matInfo;
+
+			MaterialTemplate moved = materialTemplate;
+			_materialTemplates.erase(templateIt);
+			_materialTemplates[templateKey] = moved;
+		}
+		else {
+			//Moves the parts using the material over to a template that looks the same, or one of its own
+			std::string oldKey = it->second.templateKey;
+			acquireTemplate(templateKey, matInfo);
+			it->second.templateKey = templateKey;
+			applyMaterial(matInfo->name);
+			releaseTemplate(oldKey);
+		}
+	}
+
+	MaterialEntry& entry = _materials[matInfo->name];
+	entry.templateKey = templateKey;
+	entry.contentHash = matInfo->contentHash;
+	entry.info = *matInfo;
+}
+
 void MayaViewer::renameMaterial(const char* oldName, const char* newName) {
-	Node* node = _scene->findNode(oldName);
-	if (node) {
-		node->setId(newName);
-		auto it = std::find(_materialNames.begin(), _materialNames.end(), oldName);
-		if (it != _materialNames.end()) {
-			swap(*it, _materialNames.back());
-			_materialNames.pop_back();
-			_materialNames.push_back(newName);
+	auto it = _materials.find(oldName);
+	if (it != _materials.end()) {
+		MaterialEntry entry = it->second;
+		strncpy(entry.info.name, newName, NAME_SIZE - 1);
+		_materials.erase(it);
+		_materials[newName] = entry;
+
+		for (auto& model : _models) {
+			std::vector<std::string>& materialNames = model.second.materialNames;
+			for (size_t i = 0; i < materialNames.size(); i++) {
+				if (materialNames[i] == oldName) {
+					materialNames[i] = newName;
+				}
+			}
 		}
 	}
 }
 
-void MayaViewer::changeMaterial(const char* modelName, MaterialMessage* matInfo) {
-	Node* node = _scene->findNode(modelName);
+void MayaViewer::changeMaterial(const char* modelName, const char* materialName) {
+	Node* node = findNode(modelName);
 	if (node) {
 		Model* model = (Model*)node->getDrawable();
-		if (strcmp(matInfo->diffuseTexPath, "") != 0) {
-			//Textured
-			Material* tempMaterial;
-			if (matInfo->specularPower > 0.0f) {
-				tempMaterial = model->setMaterial("res/shaders/textured.vert", "res/shaders/textured.frag", "POINT_LIGHT_COUNT 1;SPECULAR");
+		if (model) {
+			bool skinned = isSkinned(model->getMesh());
+			Material* material = findOrCreateMaterial(materialName, skinned);
+			model->setMaterial(material);
+
+			std::vector<std::string>& materialNames = _models[modelName].materialNames; //The whole mesh, every part included
+			materialNames.assign(materialNames.empty() ? 1 : materialNames.size(), materialName);
+			for (size_t i = 1; i < materialNames.size(); i++) {
+				model->setMaterial(material, (int)i);
 			}
-			else {
-				tempMaterial = model->setMaterial("res/shaders/textured.vert", "res/shaders/textured.frag", "POINT_LIGHT_COUNT 1");
+		}
+	}
+}
+
+std::string MayaViewer::getShaderDefines(bool skinned, bool specular, bool instanced) {
+	//The light counts are fixed so that adding or removing lights never recompiles a material
+	std::string defines = "POINT_LIGHT_COUNT " + std::to_string(MAX_POINT_LIGHTS) + ";DIRECTIONAL_LIGHT_COUNT " + std::to_string(MAX_DIRECTIONAL_LIGHTS) + ";SPOT_LIGHT_COUNT " + std::to_string(MAX_SPOT_LIGHTS);
+	if (skinned) { //Same for the joint count, any skin up to the max can share the material
+		defines += ";SKINNING;SKINNING_JOINT_COUNT " + std::to_string(MAX_SKIN_JOINTS);
+	}
+	if (specular) {
+		defines += ";SPECULAR";
+	}
+	if (instanced) {
+		defines += ";INSTANCED";
+	}
+	return defines;
+}
+
+void MayaViewer::precompileShaders() {
+	//Every variant a material can use is compiled up front and kept in the engine's effect cache,
+	//so creating or switching a material while working in Maya never waits on the shader compiler
+	auto start = std::chrono::steady_clock::now();
+	for (int textured = 0; textured < 2; textured++) {
+		for (int skinned = 0; skinned < 2; skinned++) {
+			for (int specular = 0; specular < 2; specular++) {
+				std::string defines = getShaderDefines(skinned != 0, specular != 0, false);
+				Effect* effect = Effect::createFromFile(gShaderPaths[textured][0], gShaderPaths[textured][1], defines.c_str());
+				if (effect) {
+					_shaderVariants.push_back(effect);
+				}
+			}
+		}
+	}
+	for (int specular = 0; _instancing && specular < 2; specular++) { //Only opaque meshes without a skin are drawn instanced
+		std::string defines = getShaderDefines(false, specular != 0, true);
+		Effect* effect = Effect::createFromFile(gShaderPaths[0][0], gShaderPaths[0][1], defines.c_str());
+		if (effect) {
+			_shaderVariants.push_back(effect);
+		}
+	}
+	std::cout << "Compiled " << _shaderVariants.size() << " shader variants in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl; //Debug
+}
+
+Material* MayaViewer::createMaterial(MaterialMessage* matInfo, bool skinned, bool instanced) {
+	std::string defines = getShaderDefines(skinned, matInfo->specularPower > 0.0f, instanced);
+	Material* material;
+	if (strcmp(matInfo->diffuseTexPath, "") != 0) {
+		//Textured
+		material = Material::create(gShaderPaths[1][0], gShaderPaths[1][1], defines.c_str());
+
+		material->getStateBlock()->setBlend(true);
+		material->getStateBlock()->setBlendSrc(RenderState::BLEND_SRC_ALPHA);
+		material->getStateBlock()->setBlendDst(RenderState::BLEND_ONE_MINUS_SRC_ALPHA);
+		_blendedMaterials.insert(material);
+	}
+	else {
+		//Colored
+		material = Material::create(gShaderPaths[0][0], gShaderPaths[0][1], defines.c_str());
+	}
+
+	//The material is shared between models, so the per-model values are not auto bound to a node
+	if (instanced) {
+		material->getParameter("u_viewProjectionMatrix")->setValue(&_drawViewProjection, 1);
+		material->getParameter("u_viewMatrix")->setValue(&_drawView, 1);
+	}
+	else {
+		material->getParameter("u_worldViewProjectionMatrix")->setValue(&_drawWorldViewProjection, 1);
+		material->getParameter("u_worldViewMatrix")->setValue(&_drawWorldView, 1);
+		material->getParameter("u_inverseTransposeWorldViewMatrix")->setValue(&_drawInverseTransposeWorldView, 1);
+	}
+	if (skinned) {
+		material->getParameter("u_matrixPalette")->setValue(_drawMatrixPalette, MAX_SKIN_JOINTS * 3);
+	}
+	material->getParameter("u_cameraPosition")->setValue(Vector3::zero()); //Lighting is done in view space
+	material->getParameter("u_ambientColor")->setValue(Vector3(0.1f, 0.1f, 0.2f));
+
+	material->getParameter("u_pointLightColor")->setValue(_pointLightColor, MAX_POINT_LIGHTS);
+	material->getParameter("u_pointLightPosition")->setValue(_pointLightPosition, MAX_POINT_LIGHTS);
+	material->getParameter("u_pointLightRangeInverse")->setValue(_pointLightRangeInverse, MAX_POINT_LIGHTS);
+	material->getParameter("u_directionalLightColor")->setValue(_directionalLightColor, MAX_DIRECTIONAL_LIGHTS);
+	material->getParameter("u_directionalLightDirection")->setValue(_directionalLightDirection, MAX_DIRECTIONAL_LIGHTS);
+	material->getParameter("u_spotLightColor")->setValue(_spotLightColor, MAX_SPOT_LIGHTS);
+	material->getParameter("u_spotLightPosition")->setValue(_spotLightPosition, MAX_SPOT_LIGHTS);
+	material->getParameter("u_spotLightDirection")->setValue(_spotLightDirection, MAX_SPOT_LIGHTS);
+	material->getParameter("u_spotLightRangeInverse")->setValue(_spotLightRangeInverse, MAX_SPOT_LIGHTS);
+	material->getParameter("u_spotLightInnerAngleCos")->setValue(_spotLightInnerAngleCos, MAX_SPOT_LIGHTS);
+	material->getParameter("u_spotLightOuterAngleCos")->setValue(_spotLightOuterAngleCos, MAX_SPOT_LIGHTS);
+
+	material->getStateBlock()->setCullFace(true);
+	material->getStateBlock()->setDepthTest(true);
+	material->getStateBlock()->setDepthWrite(true);
+
+	setMaterialValues(material, matInfo);
+	return material;
+}
+
+void MayaViewer::setMaterialValues(Material* material, MaterialMessage* matInfo) {
+	if (strcmp(matInfo->diffuseTexPath, "") != 0) {
+		setMaterialTexture(material, matInfo->diffuseTexPath);
+	}
+	else {
+		material->getParameter("u_diffuseColor")->setValue(Vector4(matInfo->color[0], matInfo->color[1], matInfo->color[2], 1.0f));
+	}
+	material->getParameter("u_specularExponent")->setValue(matInfo->specularPower);
+}
+
+void MayaViewer::setMaterialTexture(Material* material, const char* texturePath) {
+	Texture* texture = _textures->getTexture(texturePath);
+	Texture::Sampler* sampler = Texture::Sampler::create(texture);
+	sampler->setFilterMode(texture->isMipmapped() ? Texture::LINEAR_MIPMAP_LINEAR : Texture::LINEAR, Texture::LINEAR);
+	material->getParameter("u_diffuseTexture")->setValue(sampler);
+	SAFE_RELEASE(sampler);
+}
+
+void MayaViewer::uploadTextures() {
+	static std::vector<std::string> uploaded;
+	_textures->upload(TEXTURE_UPLOAD_BUDGET, uploaded);
+	if (uploaded.empty()) {
+		return;
+	}
+
+	//The materials waiting on the images swap their placeholders for the real textures
+	for (auto& it : _materialTemplates) {
+		if (strcmp(it.second.info.diffuseTexPath, "") != 0 && std::find(uploaded.begin(), uploaded.end(), it.second.info.diffuseTexPath) != uploaded.end()) {
+			setMaterialTexture(it.second.material, it.second.info.diffuseTexPath);
+			if (it.second.skinnedMaterial) {
+				setMaterialTexture(it.second.skinnedMaterial, it.second.info.diffuseTexPath);
 			}
-			Texture::Sampler* tempSampler = tempMaterial->getParameter("u_diffuseTexture")->setValue(matInfo->diffuseTexPath, true);
+		}
+	}
+}
 
-			tempMaterial->setParameterAutoBinding("u_worldViewProjectionMatrix", "WORLD_VIEW_PROJECTION_MATRIX");
-			tempMaterial->setParameterAutoBinding("u_inverseTransposeWorldViewMatrix", "INVERSE_TRANSPOSE_WORLD_VIEW_MATRIX");
-			tempMaterial->getParameter("u_ambientColor")->setValue(Vector3(0.1f, 0.1f, 0.2f));
-			tempMaterial->getParameter("u_pointLightColor[0]")->setValue(_defaultLight->getLight()->getColor());
-			tempMaterial->getParameter("u_pointLightPosition[0]")->bindValue(_defaultLight, &Node::getTranslationWorld);
-			tempMaterial->getParameter("u_pointLightRangeInverse[0]")->bindValue(_defaultLight->getLight(), &Light::getRangeInverse);
+Material* MayaViewer::findOrCreateMaterial(const char* materialName, bool skinned) {
+	auto it = _materials.find(materialName);
+	if (it == _materials.end()) { //Placeholder until the material itself is received
+		MaterialMessage matInfo;
+		strncpy(matInfo.name, materialName, NAME_SIZE - 1);
+		matInfo.color[0] = 0.5f;
+		matInfo.color[1] = 0.5f;
+		matInfo.color[2] = 0.5f;
+		defineMaterial(&matInfo);
+		it = _materials.find(materialName);
+	}
 
-			tempMaterial->getParameter("u_specularExponent")->setValue(matInfo->specularPower);
-			tempMaterial->setParameterAutoBinding("u_cameraPosition", "CAMERA_WORLD_POSITION");
+	MaterialTemplate& materialTemplate = _materialTemplates[it->second.templateKey];
+	if (skinned) {
+		if (materialTemplate.skinnedMaterial == NULL) {
+			materialTemplate.skinnedMaterial = createMaterial(&materialTemplate.info, true);
+		}
+		return materialTemplate.skinnedMaterial;
+	}
+	return materialTemplate.material;
+}
 
-			tempSampler->setFilterMode(Texture::LINEAR_MIPMAP_LINEAR, Texture::LINEAR);
+std::string MayaViewer::getTemplateKey(const MaterialMessage* matInfo) {
+	//Everything the shader and its values are made from, textured materials don't use the color
+	std::string key = strcmp(matInfo->diffuseTexPath, "") != 0 ? std::string("T") + matInfo->diffuseTexPath : std::string("C").append((const char*)matInfo->color, sizeof(matInfo->color));
+	key.append((const char*)&matInfo->specularPower, sizeof(matInfo->specularPower));
+	return key;
+}
 
-			tempMaterial->getStateBlock()->setCullFace(true);
-			tempMaterial->getStateBlock()->setDepthTest(true);
-			tempMaterial->getStateBlock()->setDepthWrite(true);
+void MayaViewer::acquireTemplate(const std::string& templateKey, MaterialMessage* matInfo) {
+	auto it = _materialTemplates.find(templateKey);
+	if (it == _materialTemplates.end()) {
+		if (strcmp(matInfo->diffuseTexPath, "") != 0) { //Before the material is created, so it starts out with the placeholder
+			_textures->acquire(matInfo->diffuseTexPath);
+		}
+		MaterialTemplate materialTemplate = { createMaterial(matInfo, false), NULL, NULL, *matInfo, 0 };
+		if (_instancing && strcmp(matInfo->diffuseTexPath, "") == 0) {
+			materialTemplate.instancedMaterial = createMaterial(matInfo, false, true);
+			_instancedMaterials[materialTemplate.material] = materialTemplate.instancedMaterial;
+		}
+		it = _materialTemplates.insert(std::make_pair(templateKey, materialTemplate)).first;
+	}
+	it->second.users++;
+}
 
-			tempMaterial->getStateBlock()->setBlend(true);
-			tempMaterial->getStateBlock()->setBlendSrc(RenderState::BLEND_SRC_ALPHA);
-			tempMaterial->getStateBlock()->setBlendDst(RenderState::BLEND_ONE_MINUS_SRC_ALPHA);
+void MayaViewer::releaseTemplate(const std::string& templateKey) {
+	auto it = _materialTemplates.find(templateKey);
+	if (it != _materialTemplates.end() && --it->second.users <= 0) { //The models have moved on, they keep their own references otherwise
+		_blendedMaterials.erase(it->second.material);
+		_blendedMaterials.erase(it->second.skinnedMaterial);
+		_instancedMaterials.erase(it->second.material);
+		SAFE_RELEASE(it->second.material);
+		SAFE_RELEASE(it->second.skinnedMaterial);
+		SAFE_RELEASE(it->second.instancedMaterial);
+		if (strcmp(it->second.info.diffuseTexPath, "") != 0) {
+			_textures->release(it->second.info.diffuseTexPath);
 		}
-		else {
-			//Colored
-			Material* tempMaterial;
-			if (matInfo->specularPower > 0.0f) {
-				tempMaterial = model->setMaterial("res/shaders/colored.vert", "res/shaders/colored.frag", "POINT_LIGHT_COUNT 1;SPECULAR");
-			}
-			else {
-				tempMaterial = model->setMaterial("res/shaders/colored.vert", "res/shaders/colored.frag", "POINT_LIGHT_COUNT 1");
+		_materialTemplates.erase(it);
+	}
+}
+
+void MayaViewer::applyMaterial(const char* materialName) {
+	for (auto& it : _models) {
+		Node* node = findNode(it.first.c_str());
+		Model* model = node ? dynamic_cast<Model*>(node->getDrawable()) : NULL;
+		if (!model) {
+			continue;
+		}
+
+		bool skinned = isSkinned(model->getMesh());
+		for (size_t i = 0; i < it.second.materialNames.size(); i++) {
+			if (it.second.materialNames[i] == materialName) {
+				Material* material = findOrCreateMaterial(materialName, skinned);
+				if (i == 0) { //The first part uses the material of the model, like createModel sets it up
+					model->setMaterial(material);
+				}
+				else {
+					model->setMaterial(material, (int)i);
+				}
 			}
-			tempMaterial->setParameterAutoBinding("u_worldViewProjectionMatrix", "WORLD_VIEW_PROJECTION_MATRIX");
-			tempMaterial->setParameterAutoBinding("u_inverseTransposeWorldViewMatrix", "INVERSE_TRANSPOSE_WORLD_VIEW_MATRIX");
-			tempMaterial->getParameter("u_diffuseColor")->setValue(Vector4(matInfo->color[0], matInfo->color[1], matInfo->color[2], 1.0f));
-			tempMaterial->getParameter("u_ambientColor")->setValue(Vector3(0.1f, 0.1f, 0.2f));
-			tempMaterial->getParameter("u_pointLightColor[0]")->setValue(_defaultLight->getLight()->getColor());
-			tempMaterial->getParameter("u_pointLightPosition[0]")->bindValue(_defaultLight, &Node::getTranslationWorld);
-			tempMaterial->getParameter("u_pointLightRangeInverse[0]")->bindValue(_defaultLight->getLight(), &Light::getRangeInverse);
+		}
+	}
+}
+
+void MayaViewer::updateLight(LightMessage* lightInfo) {
+	Light::Type type = lightInfo->type == DIRECTIONAL_LIGHT ? Light::DIRECTIONAL : lightInfo->type == SPOT_LIGHT ? Light::SPOT : Light::POINT;
+	Vector3 color = Vector3(lightInfo->color) * lightInfo->intensity;
+	float range = lightInfo->range > 0.0f ? lightInfo->range : std::numeric_limits<float>::max(); //No decay
+	float outerAngle = std::max(lightInfo->outerAngle, lightInfo->innerAngle + 0.001f); //The shaders need some falloff between the angles
+
+	Node* node = findNode(lightInfo->name);
+	if (node == NULL) {
+		node = Node::create(lightInfo->name); //Kept alive by _lightNodes until the light is removed
+		_lightNodes.push_back(node);
+		registerNode(node);
+	}
 
-			tempMaterial->getParameter("u_specularExponent")->setValue(matInfo->specularPower);
-			tempMaterial->setParameterAutoBinding("u_cameraPosition", "CAMERA_WORLD_POSITION");
+	Node* parent = findOrCreateTransform(lightInfo->parentName);
+	if (node->getParent() != parent) {
+		parent->addChild(node);
+	}
+
+	Light* light = node->getLight();
+	if (light == NULL || light->getLightType() != type) {
+		if (type == Light::DIRECTIONAL) {
+			light = Light::createDirectional(color);
+		}
+		else if (type == Light::SPOT) {
+			light = Light::createSpot(color, range, lightInfo->innerAngle, outerAngle);
+		}
+		else {
+			light = Light::createPoint(color, range);
+		}
+		node->setLight(light);
+		SAFE_RELEASE(light);
+	}
+	else {
+		light->setColor(color);
+		if (type != Light::DIRECTIONAL) {
+			light->setRange(range);
+		}
+		if (type == Light::SPOT) {
+			light->setInnerAngle(lightInfo->innerAngle);
+			light->setOuterAngle(outerAngle);
+		}
+	}
+}
 
-			tempMaterial->getStateBlock()->setCullFace(true);
-			tempMaterial->getStateBlock()->setDepthTest(true);
-			tempMaterial->getStateBlock()->setDepthWrite(true);
+void MayaViewer::removeLight(const char* lightName) {
+	for (size_t i = 0; i < _lightNodes.size(); i++) {
+		if (strcmp(_lightNodes[i]->getId(), lightName) == 0) {
+			Node* node = _lightNodes[i];
+			detachNode(node);
+			_lightNodes.erase(_lightNodes.begin() + i);
+			SAFE_RELEASE(node);
+			return;
 		}
+	}
+}
+
+void MayaViewer::bindSkin(SkinMessage* skinInfo, JointMessage* joints, SkinWeightMessage* weights, JointPoseMessage* poses) {
+	_nodeSkins.clear();
+	if (skinInfo->jointCount == 0) { //The mesh is sent again without a skin right after
+		_skins.erase(skinInfo->meshName);
+		return;
+	}
 
-		node->setDrawable(model);
+	//Only stored here, the mesh that follows is created with the weights
+	SkinEntry& skin = _skins[skinInfo->meshName];
+	skin.weights.assign(weights, weights + skinInfo->vertexCount);
+	skin.parents.resize(skinInfo->jointCount);
+	skin.inverseBindPoses.resize(skinInfo->jointCount);
+	for (size_t i = 0; i < skinInfo->jointCount; i++) {
+		skin.parents[i] = joints[i].parentIndex;
+		skin.inverseBindPoses[i].set(joints[i].inverseBindPose);
+	}
+	skin.bindShape.set(skinInfo->bindShape);
+	poseSkin(skinInfo, poses);
+}
+
+void MayaViewer::poseSkin(SkinMessage* skinInfo, JointPoseMessage* poses) {
+	auto it = _skins.find(skinInfo->meshName);
+	if (it == _skins.end() || it->second.parents.size() != skinInfo->jointCount) {
+		return;
+	}
+
+	//Same as a joint's matrix in the engine's MeshSkin, the parents come first so their world matrices are ready
+	SkinEntry& skin = it->second;
+	std::vector<Matrix> worldMatrices(skinInfo->jointCount);
+	skin.matrixPalette.resize(skinInfo->jointCount * 3);
+	for (size_t i = 0; i < skinInfo->jointCount; i++) {
+		Matrix pose(poses[i].matrix);
+		if (skin.parents[i] >= 0) {
+			Matrix::multiply(worldMatrices[skin.parents[i]], pose, &worldMatrices[i]);
+		}
+		else {
+			worldMatrices[i] = pose;
+		}
+
+		Matrix jointMatrix;
+		Matrix::multiply(worldMatrices[i], skin.inverseBindPoses[i], &jointMatrix);
+		Matrix::multiply(jointMatrix, skin.bindShape, &jointMatrix);
+		skin.matrixPalette[i * 3].set(jointMatrix.m[0], jointMatrix.m[4], jointMatrix.m[8], jointMatrix.m[12]);
+		skin.matrixPalette[i * 3 + 1].set(jointMatrix.m[1], jointMatrix.m[5], jointMatrix.m[9], jointMatrix.m[13]);
+		skin.matrixPalette[i * 3 + 2].set(jointMatrix.m[2], jointMatrix.m[6], jointMatrix.m[10], jointMatrix.m[14]);
+	}
+}
+
+void MayaViewer::updateLightUniforms() {
+	const Matrix& view = _scene->getActiveCamera()->getViewMatrix();
+	int pointCount = 0;
+	int directionalCount = 0;
+	int spotCount = 0;
+
+	//Scenes without lights are lit by the default light, like the Maya viewport
+	size_t lightCount = _lightNodes.empty() ? 1 : _lightNodes.size();
+	for (size_t i = 0; i < lightCount; i++) {
+		Node* node = _lightNodes.empty() ? _defaultLight : _lightNodes[i];
+		Light* light = node->getLight();
+		if (light == NULL || !node->isEnabledInHierarchy()) {
+			continue;
+		}
+
+		if (light->getLightType() == Light::POINT && pointCount < MAX_POINT_LIGHTS) {
+			_pointLightColor[pointCount] = light->getColor();
+			view.transformPoint(node->getTranslationWorld(), &_pointLightPosition[pointCount]);
+			_pointLightRangeInverse[pointCount] = light->getRangeInverse();
+			pointCount++;
+		}
+		else if (light->getLightType() == Light::DIRECTIONAL && directionalCount < MAX_DIRECTIONAL_LIGHTS) {
+			_directionalLightColor[directionalCount] = light->getColor();
+			view.transformVector(node->getForwardVectorWorld(), &_directionalLightDirection[directionalCount]);
+			_directionalLightDirection[directionalCount].normalize();
+			directionalCount++;
+		}
+		else if (light->getLightType() == Light::SPOT && spotCount < MAX_SPOT_LIGHTS) {
+			_spotLightColor[spotCount] = light->getColor();
+			view.transformPoint(node->getTranslationWorld(), &_spotLightPosition[spotCount]);
+			view.transformVector(node->getForwardVectorWorld(), &_spotLightDirection[spotCount]);
+			_spotLightDirection[spotCount].normalize();
+			_spotLightRangeInverse[spotCount] = light->getRangeInverse();
+			_spotLightInnerAngleCos[spotCount] = light->getInnerAngleCos();
+			_spotLightOuterAngleCos[spotCount] = light->getOuterAngleCos();
+			spotCount++;
+		}
+	}
+
+	//Unused slots are black so they add nothing, the directions are kept valid since the shaders normalize them
+	for (; pointCount < MAX_POINT_LIGHTS; pointCount++) {
+		_pointLightColor[pointCount].set(0.0f, 0.0f, 0.0f);
+		_pointLightPosition[pointCount].set(0.0f, 0.0f, 0.0f);
+		_pointLightRangeInverse[pointCount] = 0.0f;
+	}
+	for (; directionalCount < MAX_DIRECTIONAL_LIGHTS; directionalCount++) {
+		_directionalLightColor[directionalCount].set(0.0f, 0.0f, 0.0f);
+		_directionalLightDirection[directionalCount].set(0.0f, 0.0f, -1.0f);
+	}
+	for (; spotCount < MAX_SPOT_LIGHTS; spotCount++) {
+		_spotLightColor[spotCount].set(0.0f, 0.0f, 0.0f);
+		_spotLightPosition[spotCount].set(0.0f, 0.0f, 0.0f);
+		_spotLightDirection[spotCount].set(0.0f, 0.0f, -1.0f);
+		_spotLightRangeInverse[spotCount] = 0.0f;
+		_spotLightInnerAngleCos[spotCount] = 1.0f;
+		_spotLightOuterAngleCos[spotCount] = 0.0f;
 	}
 }
 
@@ -425,28 +1372,203 @@ void MayaViewer::touchEvent(Touch::TouchEvent evt, int x, int y, unsigned int co
     };
 }
 
-Mesh* MayaViewer::createMesh(std::vector<VertexMessage>& vertices) {
-	size_t vertexCount = vertices.size();
+//Room for count, or twice what there was when an edit made the mesh grow, so growing one vertex at a time doesn't rebuild it every time
+static size_t growCapacity(size_t count, size_t capacity) {
+	if (count <= capacity) {
+		return capacity;
+	}
+	return count > capacity * 2 ? count : capacity * 2;
+}
 
+Mesh* MayaViewer::createMesh(size_t vertexCapacity, bool skinned, bool dynamic) {
 	VertexFormat::Element elements[] = {
 		VertexFormat::Element(VertexFormat::POSITION, 3),
 		VertexFormat::Element(VertexFormat::NORMAL, 3),
-		VertexFormat::Element(VertexFormat::TEXCOORD0, 2)
+		VertexFormat::Element(VertexFormat::TEXCOORD0, 2),
+		VertexFormat::Element(VertexFormat::BLENDWEIGHTS, 4),
+		VertexFormat::Element(VertexFormat::BLENDINDICES, 4)
 	};
-	Mesh* mesh = Mesh::createMesh(VertexFormat(elements, 3), vertexCount, false);
+	Mesh* mesh = Mesh::createMesh(VertexFormat(elements, skinned ? 5 : 3), (unsigned int)vertexCapacity, dynamic);
 	if (mesh == NULL) {
 		GP_ERROR("Failed to create mesh.");
 		return NULL;
 	}
-	mesh->setVertexData(vertices.data(), 0, vertexCount);
 	return mesh;
 }
 
-void MayaViewer::updateTransform(Vector3 translation, Quaternion rotation, Vector3 scale, const char* nodeName) {
-	Node* node = _scene->findNode(nodeName);
-	if (node) {
-		node->setScale(scale);
-		node->setTranslation(translation);
-		node->setRotation(rotation);
+void MayaViewer::writeVertices(Mesh* mesh, const VertexMessage* vertices, const SkinWeightMessage* weights, size_t vertexCount, size_t clearCount) {
+	//Vertices past vertexCount are zeroed up to clearCount, a mesh without parts draws them all as triangles with no area
+	setMeshBounds(mesh, vertices, vertexCount);
+	std::vector<float> vertexData;
+	size_t writeCount;
+	const void* data = packVertices(vertices, weights, vertexCount, clearCount, mesh->getVertexSize() / sizeof(float), vertexData, &writeCount);
+	mesh->setVertexData(data, 0, (unsigned int)writeCount);
+}
+
+void MayaViewer::setMeshBounds(Mesh* mesh, const VertexMessage* vertices, size_t vertexCount) {
+	BoundingBox box;
+	BoundingSphere sphere;
+	computeMeshBounds(vertices, vertexCount, &box, &sphere);
+	mesh->setBoundingBox(box);
+	mesh->setBoundingSphere(sphere);
+}
+
+void MayaViewer::writeParts(Mesh* mesh, const MeshPartMessage* parts, size_t partCount) {
+	//Each part only indexes its own run of vertices, the indices left over point at one vertex so they draw nothing
+	std::vector<unsigned int> indices;
+	for (unsigned int i = 0; i < mesh->getPartCount() && i < partCount; i++) {
+		MeshPart* part = mesh->getPart(i);
+		indices.assign(part->getIndexCount(), 0);
+		for (size_t j = 0; j < parts[i].vertexCount; j++) {
+			indices[j] = (unsigned int)(parts[i].firstVertex + j);
+		}
+		part->setIndexData(indices.data(), 0, (unsigned int)indices.size());
+	}
+}
+
+Model* MayaViewer::createModel(const char* modelName, const VertexMessage* vertices, size_t vertexCount, const MeshPartMessage* parts, size_t partCount, const SkinEntry* skin, Mesh* previous) {
+	//A mesh replacing one that was edited is dynamic and gets room to grow, so the next edits can be written into its buffers
+	bool skinned = skin != NULL && skin->weights.size() == vertexCount && vertexCount > 0;
+	size_t vertexCapacity = previous ? growCapacity(vertexCount, previous->getVertexCount()) : vertexCount;
+	Mesh* mesh = createMesh(vertexCapacity, skinned, previous != NULL);
+	writeVertices(mesh, vertices, skinned ? skin->weights.data() : NULL, vertexCount, vertexCapacity);
+	if (partCount > 1) { //All parts share one vertex buffer
+		bool sameParts = previous && previous->getPartCount() == partCount;
+		for (size_t i = 0; i < partCount; i++) {
+			size_t indexCapacity = sameParts ? growCapacity(parts[i].vertexCount, previous->getPart((unsigned int)i)->getIndexCount()) : parts[i].vertexCount;
+			mesh->addPart(Mesh::TRIANGLES, Mesh::INDEX32, (unsigned int)indexCapacity, previous != NULL);
+		}
+		writeParts(mesh, parts, partCount);
+	}
+
+	Model* model = Model::create(mesh);
+	SAFE_RELEASE(mesh); //The model keeps its own reference
+	setModelMaterials(modelName, model, parts, partCount, skinned);
+	_models[modelName].vertexCount = vertexCount;
+	return model;
+}
+
+void MayaViewer::setModelMaterials(const char* modelName, Model* model, const MeshPartMessage* parts, size_t partCount, bool skinned) {
+	model->setMaterial(findOrCreateMaterial(partCount > 0 ? parts[0].materialName : "", skinned)); //The model only holds a reference to the shared material
+	for (size_t i = 1; i < partCount; i++) {
+		model->setMaterial(findOrCreateMaterial(parts[i].materialName, skinned), (int)i);
+	}
+
+	ModelEntry& entry = _models[modelName];
+	std::vector<std::string>& materialNames = entry.materialNames; //So the parts can follow their Maya material to another template
+	materialNames.assign(1, partCount > 0 ? parts[0].materialName : "");
+	for (size_t i = 1; i < partCount; i++) {
+		materialNames.push_back(parts[i].materialName);
+	}
+	entry.parts.assign(parts, parts + partCount);
+}
+
+Model* MayaViewer::createOrShareModel(const char* modelName, const VertexMessage* vertices, size_t vertexCount, const MeshPartMessage* parts, size_t partCount, unsigned long long contentHash) {
+	//A duplicated mesh has the same hash, so it only gets a model of its own around the mesh that is already uploaded.
+	//The draws are sorted by material and vertex buffer, so the opaque duplicates end up next to each other and are drawn in one instanced call
+	auto skinIt = _skins.find(modelName); //The skin is sent before the mesh, skinned meshes are never shared
+	bool shareable = skinIt == _skins.end() && contentHash != 0;
+	if (shareable) {
+		auto sharedIt = _sharedMeshes.find(contentHash);
+		if (sharedIt != _sharedMeshes.end()) {
+			Model* model = Model::create(sharedIt->second.mesh);
+			setModelMaterials(modelName, model, parts, partCount, false);
+			ModelEntry& entry = _models[modelName];
+			entry.vertexCount = sharedIt->second.mesh->getVertexCount(); //A duplicate is sent without its vertices
+			entry.sharedHash = contentHash;
+			sharedIt->second.users++;
+			return model;
+		}
+	}
+
+	Model* model = createModel(modelName, vertices, vertexCount, parts, partCount, skinIt != _skins.end() ? &skinIt->second : NULL);
+	if (shareable) { //Not dynamic, so an edit never writes into it and gives the edited model a mesh of its own instead
+		SharedMesh& shared = _sharedMeshes[contentHash];
+		shared.mesh = model->getMesh();
+		shared.mesh->addRef();
+		shared.users = 1;
+		_models[modelName].sharedHash = contentHash;
+	}
+	return model;
+}
+
+void MayaViewer::releaseSharedMesh(ModelEntry& entry) {
+	//Called before the model lets go of the mesh, the last one to go takes it out of the map
+	if (entry.sharedHash == 0) {
+		return;
+	}
+	auto it = _sharedMeshes.find(entry.sharedHash);
+	entry.sharedHash = 0;
+	if (it != _sharedMeshes.end() && --it->second.users == 0) {
+		auto instancedIt = _instancedModels.find(it->second.mesh);
+		if (instancedIt != _instancedModels.end()) {
+			SAFE_RELEASE(instancedIt->second);
+			_instancedModels.erase(instancedIt);
+		}
+		SAFE_RELEASE(it->second.mesh);
+		_sharedMeshes.erase(it);
+	}
+}
+
+Node* MayaViewer::findNode(const char* name) {
+	auto it = _nodes.find(name);
+	return it != _nodes.end() ? it->second : NULL;
+}
+
+void MayaViewer::registerNode(Node* node) {
+	_nodes[node->getId()] = node;
+}
+
+void MayaViewer::forgetNode(Node* node) {
+	//The children go with the node unless something else holds on to them
+	auto it = _nodes.find(node->getId());
+	if (it != _nodes.end() && it->second == node) {
+		_nodes.erase(it);
+		auto modelIt = node->getDrawable() ? _models.find(node->getId()) : _models.end();
+		if (modelIt != _models.end()) {
+			releaseSharedMesh(modelIt->second);
+		}
+	}
+	_nodeSkins.erase(node);
+	for (Node* child = node->getFirstChild(); child; child = child->getNextSibling()) {
+		forgetNode(child);
+	}
+}
+
+Node* MayaViewer::findOrCreateTransform(const char* transformName) {
+	Node* node = findNode(transformName);
+	if (node == NULL) { //Placeholder until the transform itself is received, its parent is set then
+		node = _scene->addNode(transformName);
+		registerNode(node);
+	}
+	return node;
+}
+
+void MayaViewer::detachNode(Node* node) {
+	forgetNode(node);
+	if (node->getParent()) {
+		node->getParent()->removeChild(node);
 	}
+	else {
+		_scene->removeNode(node);
+	}
+}
+
+void MayaViewer::updateTransform(TransformMessage* transformInfo) {
+	Node* node = findOrCreateTransform(transformInfo->name);
+
+	//Keep the hierarchy in sync with Maya, the world matrices are then handled by the nodes themselves
+	if (strcmp(transformInfo->parentName, "") == 0) {
+		if (node->getParent()) {
+			_scene->addNode(node);
+		}
+	}
+	else {
+		Node* parent = findOrCreateTransform(transformInfo->parentName);
+		if (node->getParent() != parent) {
+			parent->addChild(node);
+		}
+	}
+
+	node->set(Vector3(transformInfo->scale), Quaternion(transformInfo->rotation), Vector3(transformInfo->translation)); //Already decomposed by the plugin
 }
@@ -2,11 +2,20 @@
 #define MayaViewer_H_
 
 #include <vector>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <chrono>
 
 #include "gameplay.h"
 #include "ComLib.h"
 #include "DebugConsole.h"
 #include "MessageTypes.h"
+#include "ClipCodec.h"
+#include "TextureCache.h"
+#include "MessageReceiver.h"
+#include "MeshUpload.h"
 
 using namespace gameplay;
 
@@ -25,12 +34,20 @@ public:
 
 	bool mouseEvent(Mouse::MouseEvent evt, int x, int y, int wheelDelta) override;
 
-	void addNewModel(const char* modelName, std::vector<VertexMessage>& vertices, MaterialMessage* matInfo);
+	void addNewModel(const char* modelName, const char* parentName, const VertexMessage* vertices, size_t vertexCount, const MeshPartMessage* parts, size_t partCount, unsigned long long contentHash, bool duplicate);
+	void addCamera(CameraMessage* camInfo);
 	void removeModel(const char* modelName);
+	void removeTransform(const char* transformName);
 	void renameModel(const char* oldName, const char* newName);
-	void updateModel(const char* modelName, std::vector<VertexMessage>& vertices);
+	void updateModel(const char* modelName, const VertexMessage* vertices, size_t vertexCount, const MeshPartMessage* parts, size_t partCount, unsigned long long contentHash);
+	void defineMaterial(MaterialMessage* matInfo);
 	void renameMaterial(const char* oldName, const char* newName);
-	void changeMaterial(const char* modelName, MaterialMessage* matInfo);
+	void changeMaterial(const char* modelName, const char* materialName);
+	void updateLight(LightMessage* lightInfo);
+	void removeLight(const char* lightName);
+	void bindSkin(SkinMessage* skinInfo, JointMessage* joints, SkinWeightMessage* weights, JointPoseMessage* poses);
+	void poseSkin(SkinMessage* skinInfo, JointPoseMessage* poses);
+	size_t getMessageBacklog() const; //Bytes the plugin has written that are still waiting for us
 
 protected:
 
@@ -44,15 +61,144 @@ protected:
 
 private:
 
-	ComLib _comLib;
+	//Every material is compiled with room for this many lights, unused slots are left black
+	static const int MAX_POINT_LIGHTS = 4;
+	static const int MAX_DIRECTIONAL_LIGHTS = 2;
+	static const int MAX_SPOT_LIGHTS = 2;
+	static const unsigned int TEXTURE_DECODE_THREADS = 2;
+	static const size_t TEXTURE_UPLOAD_BUDGET = 16 << 20; //Bytes of decoded images uploaded per frame, one bigger image still goes
+	static const int MESSAGE_TIME_BUDGET = 8; //Milliseconds spent on messages per frame
+	static const size_t MESSAGE_BYTE_BUDGET = 8 << 20; //Bytes of messages handled per frame, one bigger message still goes
+	static const size_t MESSAGE_QUEUE_SIZE = 4096; //Messages received ahead of the render thread
+	static const size_t MESSAGE_QUEUE_BYTES = 256 << 20; //Of the arena the messages are received into
+	static const bool PRINT_MESSAGE_STATISTICS = false; //Throughput after every backlog and on exit, benchmark/MessageBenchmark measures it without Maya
+	static const bool PRINT_DRAW_STATISTICS = false; //Draw calls, state changes, culled and instanced models, counted either way
+	static const int DRAW_REPORT_INTERVAL = 2; //Seconds between printing the draw statistics, only when they changed
 
-    bool drawScene(Node* node); //Draws the scene each frame
-	void fetchMessage();
+	//One material per distinct look, every Maya material with the same shader and values shares it
+	struct MaterialTemplate {
+		Material* material;
+		Material* skinnedMaterial; //Created the first time a skinned mesh uses the template
+		Material* instancedMaterial; //Draws the duplicates of a mesh in one call, NULL for the blended ones which are drawn one by one
+		MaterialMessage info; //The values it was made from, kept to create the skinned material
+		int users; //Maya materials using the template
+	};
 
-	Mesh* createMesh(std::vector<VertexMessage>& vertices);
-	Material* createMaterial();
+	struct MaterialEntry {
+		std::string templateKey;
+		unsigned long long contentHash;
+		MaterialMessage info;
+	};
 
-	void updateTransform(Vector3 translation, Quaternion rotation, Vector3 scale, const char* nodeName);
+	//The joints are posed in Maya and the vertices are skinned in the shaders
+	struct SkinEntry {
+		std::vector<SkinWeightMessage> weights; //Used when the mesh is created, one per vertex
+		std::vector<int> parents;
+		std::vector<Matrix> inverseBindPoses;
+		Matrix bindShape;
+		std::vector<Vector4> matrixPalette; //Three rows per joint, laid out the way the shaders read them
+	};
+
+	//What is kept for every mesh besides its node
+	struct ModelEntry {
+		std::vector<std::string> materialNames; //Maya material of every part
+		std::vector<MeshPartMessage> parts; //Kept so a model sharing its mesh can be given one of its own
+		size_t vertexCount = 0; //In use, a mesh that has been edited has room for more
+		unsigned long long sharedHash = 0; //Of the mesh it shares with its duplicates, 0 when it has one of its own
+	};
+
+	//A mesh uploaded once for every duplicate of it
+	struct SharedMesh {
+		Mesh* mesh;
+		size_t users; //Models drawing it, the mesh is released with the last one
+	};
+
+	//A track of a frame range baked in Maya, decoded when it arrives so playing it only interpolates
+	struct ClipTrack {
+		std::string name;
+		TrackType type;
+		size_t channelCount;
+		std::vector<float> samples; //channelCount values per frame
+		std::vector<VertexMessage> vertices; //POINTS_TRACK only, the positions are rebuilt every frame
+		std::vector<unsigned int> pointIndices;
+	};
+
+	//A model that passed culling this frame
+	struct DrawItem {
+		Node* node;
+		Model* model;
+		Material* material; //Of the first part, the opaque draws are sorted by it and then by the vertex buffer
+		VertexBufferHandle vertexBuffer;
+		const SkinEntry* skin; //NULL unless the model is skinned
+		float depth; //View space z of the bounds, the blended draws are sorted back to front by it
+	};
+
+	struct DrawStatistics {
+		size_t drawCalls = 0; //One per mesh part
+		size_t stateChanges = 0; //Material or vertex buffer switches between draws
+		size_t culled = 0;
+		size_t instances = 0; //Models drawn together with their duplicates
+	};
+
+	//A view change with the camera matrix already decomposed by the ingest thread
+	struct PendingView {
+		CameraMessage info;
+		Vector3 translation;
+		Quaternion rotation;
+	};
+
+	ComLib _comLib; //Only read by _receiver's ingest thread
+	ComLib _viewerComLib; //Back to the plugin
+	MessageReceiver* _receiver;
+
+    bool queueDraw(Node* node); //Culls the node and queues its model for this frame
+	void drawItem(const DrawItem& item);
+	bool canInstance(const DrawItem& first, const DrawItem& item) const;
+	void drawInstances(const DrawItem* items, size_t count);
+	const SkinEntry* findNodeSkin(Node* node);
+	static void setMeshBounds(Mesh* mesh, const VertexMessage* vertices, size_t vertexCount);
+	void drainMessages();
+	void printMessageStatistics();
+	void applyMessage(const MessageReceiver::Message& message);
+	void queueTransform(TransformMessage* transformInfo);
+	void queueView(CameraMessage* camInfo, const Vector3& translation, const Quaternion& rotation);
+	void flushPendingUpdates();
+	void changeView(CameraMessage* camInfo, const Vector3& translation, const Quaternion& rotation);
+	void loadSnapshot(char* snapshot);
+	void sendContentHashes();
+	void requestClip();
+	void requestMesh(const char* meshName);
+	void loadClip(char* clip, size_t clipSize);
+	void playClip(float elapsedTime);
+	void applyClipFrame(float frame);
+	void stopClip();
+	void updateLightUniforms();
+
+	Mesh* createMesh(size_t vertexCapacity, bool skinned, bool dynamic);
+	void writeVertices(Mesh* mesh, const VertexMessage* vertices, const SkinWeightMessage* weights, size_t vertexCount, size_t clearCount);
+	void writeParts(Mesh* mesh, const MeshPartMessage* parts, size_t partCount);
+	Model* createModel(const char* modelName, const VertexMessage* vertices, size_t vertexCount, const MeshPartMessage* parts, size_t partCount, const SkinEntry* skin, Mesh* previous = NULL);
+	void setModelMaterials(const char* modelName, Model* model, const MeshPartMessage* parts, size_t partCount, bool skinned);
+	Model* createOrShareModel(const char* modelName, const VertexMessage* vertices, size_t vertexCount, const MeshPartMessage* parts, size_t partCount, unsigned long long contentHash);
+	void releaseSharedMesh(ModelEntry& entry);
+	static std::string getShaderDefines(bool skinned, bool specular, bool instanced);
+	void precompileShaders();
+	Material* createMaterial(MaterialMessage* matInfo, bool skinned, bool instanced = false);
+	void setMaterialValues(Material* material, MaterialMessage* matInfo);
+	void setMaterialTexture(Material* material, const char* texturePath);
+	void uploadTextures();
+	Material* findOrCreateMaterial(const char* materialName, bool skinned);
+	static std::string getTemplateKey(const MaterialMessage* matInfo);
+	void acquireTemplate(const std::string& templateKey, MaterialMessage* matInfo);
+	void releaseTemplate(const std::string& templateKey);
+	void applyMaterial(const char* materialName);
+
+	Node* findNode(const char* name);
+	void registerNode(Node* node);
+	void forgetNode(Node* node);
+	Node* findOrCreateTransform(const char* transformName);
+	void detachNode(Node* node);
+	void updateTransform(TransformMessage* transformInfo);
 
 	//std::vector<Model*> _models;
 	//std::vector <Material*> _mats;
@@ -60,8 +206,66 @@ private:
 
 	size_t _modelCount;
 	size_t _materialCount;
-	std::vector<std::string> _modelnames;
-	std::vector<std::string> _materialNames;
+	std::unordered_map<std::string, Node*> _nodes; //Every node made for something in Maya, by name, instead of searching the scene
+	std::unordered_map<std::string, MaterialEntry> _materials; //By Maya material name
+	std::unordered_map<std::string, MaterialTemplate> _materialTemplates; //By getTemplateKey, every mesh part points to one of these
+	std::unordered_map<std::string, ModelEntry> _models; //By model name, the node is found through _nodes
+	std::unordered_map<unsigned long long, SharedMesh> _sharedMeshes; //By content hash, duplicated meshes are uploaded once and drawn from the same buffers
+	std::unordered_map<Mesh*, Model*> _instancedModels; //Of the shared meshes whose duplicates have been drawn together, holding the instanced materials
+	std::unordered_map<Material*, Material*> _instancedMaterials; //From the material of a template to its instanced one
+	bool _instancing; //The renderer can draw the duplicates of a mesh in one call
+	TextureCache* _textures; //Every textured template holds a reference to its image file
+	std::vector<Effect*> _shaderVariants; //Held so they stay in the engine's effect cache
+	std::unordered_map<std::string, unsigned long long> _meshHashes; //Lets a reloaded plugin skip the meshes we already have
+	std::unordered_map<std::string, SkinEntry> _skins; //By mesh name
+	std::unordered_map<Node*, const SkinEntry*> _nodeSkins; //Found once for each skinned model that is drawn, emptied whenever a skin is bound or removed
+
+	//Transform and camera changes are applied once per frame with their latest values
+	std::vector<TransformMessage> _pendingTransforms;
+	std::unordered_map<std::string, size_t> _pendingTransformIndices; //By transform name, into _pendingTransforms
+	std::vector<PendingView> _pendingViews; //The last one is the active camera
+	size_t _messageBacklog;
+	size_t _peakMessageBacklog; //Since the backlog last ran empty
+	size_t _backlogFrames;
+	size_t _appliedBytes;
+	double _applySeconds;
+
+	std::vector<ClipTrack> _clipTracks;
+	size_t _clipFrameCount;
+	float _clipFrameRate;
+	size_t _clipCurrentFrame; //Where Maya is, shown again when the clip stops
+	float _clipTime; //In frames
+	bool _clipPlaying;
+
+	std::vector<DrawItem> _opaqueDraws;
+	std::vector<DrawItem> _blendedDraws;
+	std::unordered_set<Material*> _blendedMaterials; //The textured ones, they are drawn after everything opaque
+	DrawStatistics _drawStatistics; //Of the last frame
+	DrawStatistics _reportedDrawStatistics;
+	float _drawReportTime;
+
+	//Values of the current draw, the shared materials point to these instead of being bound to a node
+	Matrix _drawWorldViewProjection;
+	Matrix _drawWorldView;
+	Matrix _drawInverseTransposeWorldView;
+	Vector4 _drawMatrixPalette[MAX_SKIN_JOINTS * 3];
+	Matrix _drawViewProjection; //The instanced materials take the world matrices from the mesh instead
+	Matrix _drawView;
+	std::vector<Matrix> _instanceMatrices;
+
+	//Packed once per frame in view space, the materials point to these arrays
+	std::vector<Node*> _lightNodes;
+	Vector3 _pointLightColor[MAX_POINT_LIGHTS];
+	Vector3 _pointLightPosition[MAX_POINT_LIGHTS];
+	float _pointLightRangeInverse[MAX_POINT_LIGHTS];
+	Vector3 _directionalLightColor[MAX_DIRECTIONAL_LIGHTS];
+	Vector3 _directionalLightDirection[MAX_DIRECTIONAL_LIGHTS];
+	Vector3 _spotLightColor[MAX_SPOT_LIGHTS];
+	Vector3 _spotLightPosition[MAX_SPOT_LIGHTS];
+	Vector3 _spotLightDirection[MAX_SPOT_LIGHTS];
+	float _spotLightRangeInverse[MAX_SPOT_LIGHTS];
+	float _spotLightInnerAngleCos[MAX_SPOT_LIGHTS];
+	float _spotLightOuterAngleCos[MAX_SPOT_LIGHTS];
 
 	Node* _defaultLight;
     Scene* _scene;
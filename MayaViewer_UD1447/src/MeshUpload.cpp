@@ -0,0 +1,44 @@
+#include "MeshUpload.h"
+
+void computeMeshBounds(const VertexMessage* vertices, size_t vertexCount, BoundingBox* box, BoundingSphere* sphere) {
+	if (vertexCount == 0) {
+		*box = BoundingBox();
+		*sphere = BoundingSphere();
+		return;
+	}
+	Vector3 minimum(vertices[0].pos);
+	Vector3 maximum(vertices[0].pos);
+	for (size_t i = 1; i < vertexCount; i++) {
+		const float* pos = vertices[i].pos;
+		minimum.set(pos[0] < minimum.x ? pos[0] : minimum.x, pos[1] < minimum.y ? pos[1] : minimum.y, pos[2] < minimum.z ? pos[2] : minimum.z);
+		maximum.set(pos[0] > maximum.x ? pos[0] : maximum.x, pos[1] > maximum.y ? pos[1] : maximum.y, pos[2] > maximum.z ? pos[2] : maximum.z);
+	}
+	Vector3 center = (minimum + maximum) * 0.5f;
+	float radiusSquared = 0.0f;
+	for (size_t i = 0; i < vertexCount; i++) {
+		float distanceSquared = center.distanceSquared(Vector3(vertices[i].pos));
+		radiusSquared = distanceSquared > radiusSquared ? distanceSquared : radiusSquared;
+	}
+	box->set(minimum, maximum);
+	sphere->set(center, sqrt(radiusSquared));
+}
+
+const void* packVertices(const VertexMessage* vertices, const SkinWeightMessage* weights, size_t vertexCount, size_t clearCount,
+	size_t floatCount, std::vector<float>& vertexData, size_t* writeCount) {
+	*writeCount = vertexCount > clearCount ? vertexCount : clearCount;
+	if (weights == NULL && floatCount == 8 && *writeCount == vertexCount) {
+		return vertices;
+	}
+
+	//The weights come in their own section, so they are interleaved with the vertices here
+	vertexData.assign(*writeCount * floatCount, 0.0f);
+	for (size_t i = 0; i < vertexCount; i++) {
+		float* vertex = &vertexData[i * floatCount];
+		memcpy(vertex, &vertices[i], sizeof(float) * 8);
+		if (weights && floatCount == 16) {
+			memcpy(vertex + 8, weights[i].weights, sizeof(float) * 4);
+			memcpy(vertex + 12, weights[i].joints, sizeof(float) * 4);
+		}
+	}
+	return vertexData.data();
+}
@@ -0,0 +1,31 @@
+#ifndef MeshUpload_H_
+#define MeshUpload_H_
+
+#include <vector>
+
+#include "gameplay.h"
+#include "MessageTypes.h"
+
+using namespace gameplay;
+
+/**
+ * The CPU side of uploading received vertices into a mesh, everything before the buffer is written.
+ * Kept out of the viewer so benchmark/MessageBenchmark can time it without a window or a GL context.
+ */
+
+/**
+ * Bounds used for culling, the sphere is centered on the box and reaches the vertex furthest from it.
+ */
+void computeMeshBounds(const VertexMessage* vertices, size_t vertexCount, BoundingBox* box, BoundingSphere* sphere);
+
+/**
+ * Lays the vertices out the way a mesh with floatCount floats per vertex stores them, interleaving the weights when given.
+ * Vertices past vertexCount are zeroed up to clearCount.
+ *
+ * @return What to upload. Unskinned vertices that fill the buffer are uploaded straight from where they were received,
+ *         anything else is packed into vertexData. writeCount is set to the amount of vertices to upload.
+ */
+const void* packVertices(const VertexMessage* vertices, const SkinWeightMessage* weights, size_t vertexCount, size_t clearCount,
+	size_t floatCount, std::vector<float>& vertexData, size_t* writeCount);
+
+#endif
@@ -0,0 +1,206 @@
+#include "MessageReceiver.h"
+#include <chrono>
+#include <iostream>
+
+MessageReceiver::MessageReceiver(ComLib& comLib, size_t queueSize, size_t byteLimit) : _comLib(comLib) {
+	_arenaSize = byteLimit > comLib.getSizeBytes() ? byteLimit : comLib.getSizeBytes();
+	_arenaSize = (_arenaSize + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+	_arena = new char[_arenaSize];
+	_allocated = 0;
+	_released = 0;
+
+	_messages.resize(queueSize > 0 ? queueSize : 1);
+	_head = 0;
+	_tail = 0;
+	_waitingBytes = 0;
+	_messagesReceived = 0;
+	_bytesReceived = 0;
+	_dropped = 0;
+	_receiveNanoseconds = 0;
+	_peakQueuedBytes = 0;
+	_stopping = false;
+
+	_thread = std::thread(&MessageReceiver::ingestLoop, this);
+}
+
+MessageReceiver::~MessageReceiver() {
+	_stopping = true;
+	_thread.join();
+	delete[] _arena; //Queued messages only point into it
+}
+
+const MessageReceiver::Message* MessageReceiver::front() {
+	size_t head = _head.load(std::memory_order_relaxed);
+	if (head == _tail.load(std::memory_order_acquire)) {
+		return NULL;
+	}
+	return &_messages[head % _messages.size()];
+}
+
+void MessageReceiver::pop() {
+	size_t head = _head.load(std::memory_order_relaxed);
+	Message& message = _messages[head % _messages.size()];
+	_released.fetch_add(message.arenaSize, std::memory_order_release); //Messages are popped in the order they were allocated
+	message.data = NULL;
+
+	_head.store(head + 1, std::memory_order_release); //Frees the slot for the ingest thread
+}
+
+size_t MessageReceiver::getBacklog() const {
+	size_t released = _released; //Read first, _allocated never falls behind it
+	return _allocated - released + _waitingBytes;
+}
+
+MessageReceiver::Statistics MessageReceiver::getStatistics() const {
+	Statistics statistics;
+	statistics.messagesReceived = _messagesReceived;
+	statistics.bytesReceived = _bytesReceived;
+	statistics.dropped = _dropped;
+	statistics.receiveSeconds = _receiveNanoseconds / 1e9;
+	statistics.peakQueuedBytes = _peakQueuedBytes;
+	return statistics;
+}
+
+void MessageReceiver::ingestLoop() {
+	while (_stopping == false) {
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		size_t msgSize = _comLib.nextSize();
+		if (msgSize == 0) {
+			_waitingBytes = 0;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1)); //The ComLib can't wake us, so it is polled
+			continue;
+		}
+
+		//A message never wraps around the end of the arena, the room left there is skipped and given back with it
+		size_t allocated = _allocated.load(std::memory_order_relaxed);
+		size_t queuedBytes = allocated - _released.load(std::memory_order_acquire);
+		size_t offset = allocated % _arenaSize;
+		size_t alignedSize = (msgSize + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+		size_t skipped = offset + alignedSize > _arenaSize ? _arenaSize - offset : 0;
+		bool full = tail - _head.load(std::memory_order_acquire) == _messages.size() || (queuedBytes > 0 && queuedBytes + skipped + alignedSize > _arenaSize);
+		if (full) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		Message message;
+		message.data = _arena + (skipped > 0 ? 0 : offset);
+		message.size = msgSize;
+		message.arenaSize = skipped + alignedSize;
+		if (_comLib.recv(message.data, msgSize) == false) { //The buffer wrapped around, the message is read from the start next time
+			continue;
+		}
+		_waitingBytes = _comLib.nextSize() > 0 ? _comLib.getSizeBytes() - _comLib.getFreeMemory() : 0;
+
+		bool parsed = parse(message);
+		_receiveNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		if (parsed == false) {
+			std::cout << "A message of type " << message.type << " was shorter than its contents and was dropped" << std::endl; //Debug
+			_dropped++;
+			continue; //Its room in the arena is simply used again
+		}
+
+		_messagesReceived++;
+		_bytesReceived += msgSize;
+		queuedBytes += message.arenaSize;
+		if (queuedBytes > _peakQueuedBytes) {
+			_peakQueuedBytes = queuedBytes;
+		}
+
+		_messages[tail % _messages.size()] = message;
+		_allocated.store(allocated + message.arenaSize, std::memory_order_relaxed);
+		_tail.store(tail + 1, std::memory_order_release); //Hands the message to the render thread
+	}
+}
+
+bool MessageReceiver::parse(Message& message) {
+	//The counts a message declares are checked against its size, so the render thread can walk the sections without checking
+	if (message.size < sizeof(MessageHeader)) {
+		return false;
+	}
+	message.type = ((MessageHeader*)message.data)->type;
+	char* body = message.data + sizeof(MessageHeader);
+	size_t bodySize = message.size - sizeof(MessageHeader);
+
+	MessageType type = message.type;
+	if (type == MESH_ADDED || type == MESH_TOPOLOGY_CHANGED) {
+		if (bodySize < sizeof(MeshMessage)) {
+			return false;
+		}
+		MeshMessage* meshInfo = (MeshMessage*)body;
+		size_t expectedSize = sizeof(MeshMessage) + sizeof(MeshPartMessage) * meshInfo->partCount + sizeof(VertexMessage) * meshInfo->vertexCount;
+		expectedSize += type == MESH_ADDED ? sizeof(TransformMessage) : 0; //The transform the mesh is attached to comes last
+		return bodySize >= expectedSize;
+	}
+	else if (type == MESH_REMOVED || type == MESH_RENAMED || type == MATERIAL_CHANGED) {
+		return bodySize >= sizeof(MeshMessage);
+	}
+	else if (type == TRANSFORM_CHANGED || type == TRANSFORM_REMOVED || type == TRANSFORM_RENAMED) {
+		return bodySize >= sizeof(TransformMessage);
+	}
+	else if (type == CAMERA_ADDED || type == VIEW_CHANGED) {
+		if (bodySize < sizeof(CameraMessage)) {
+			return false;
+		}
+		if (type == VIEW_CHANGED) {
+			Matrix matrix(((CameraMessage*)body)->transformationMatrix);
+			Vector3 scale;
+			matrix.decompose(&scale, &message.viewRotation, &message.viewTranslation);
+		}
+		return true;
+	}
+	else if (type == MATERIAL_DEFINED || type == MATERIAL_UPDATED || type == MATERIAL_RENAMED) {
+		return bodySize >= sizeof(MaterialMessage);
+	}
+	else if (type == LIGHT_ADDED || type == LIGHT_CHANGED || type == LIGHT_REMOVED || type == LIGHT_RENAMED) {
+		return bodySize >= sizeof(LightMessage);
+	}
+	else if (type == SKIN_BOUND || type == SKIN_POSED) {
+		if (bodySize < sizeof(SkinMessage)) {
+			return false;
+		}
+		SkinMessage* skinInfo = (SkinMessage*)body;
+		size_t expectedSize = sizeof(SkinMessage) + sizeof(JointPoseMessage) * skinInfo->jointCount;
+		if (type == SKIN_BOUND) {
+			expectedSize += sizeof(JointMessage) * skinInfo->jointCount + sizeof(SkinWeightMessage) * skinInfo->vertexCount;
+		}
+		return bodySize >= expectedSize;
+	}
+	else if (type == SCENE_SNAPSHOT) {
+		if (bodySize < sizeof(SceneSnapshotMessage)) {
+			return false;
+		}
+		SceneSnapshotMessage* snapshotInfo = (SceneSnapshotMessage*)body;
+		size_t meshesOffset = sizeof(SceneSnapshotMessage) + sizeof(CameraMessage) * snapshotInfo->cameraCount + sizeof(MaterialMessage) * snapshotInfo->materialCount
+			+ sizeof(TransformMessage) * snapshotInfo->transformCount + sizeof(LightMessage) * snapshotInfo->lightCount;
+		size_t expectedSize = meshesOffset + sizeof(MeshMessage) * snapshotInfo->meshCount
+			+ sizeof(MeshPartMessage) * snapshotInfo->partCount + sizeof(VertexMessage) * snapshotInfo->vertexCount;
+		if (bodySize < expectedSize) {
+			return false;
+		}
+
+		//The render thread walks the parts and vertices mesh by mesh, so the meshes can't claim more than the totals
+		MeshMessage* meshes = (MeshMessage*)(body + meshesOffset);
+		size_t partsLeft = snapshotInfo->partCount;
+		size_t verticesLeft = snapshotInfo->vertexCount;
+		for (size_t i = 0; i < snapshotInfo->meshCount; i++) {
+			if (meshes[i].partCount > partsLeft || meshes[i].vertexCount > verticesLeft) {
+				return false;
+			}
+			partsLeft -= meshes[i].partCount;
+			verticesLeft -= meshes[i].vertexCount;
+		}
+		return true;
+	}
+	else if (type == CLIP) {
+		if (bodySize < sizeof(ClipMessage)) {
+			return false;
+		}
+		//Only the track table, the track data is checked while it is decoded
+		ClipMessage* clipInfo = (ClipMessage*)body;
+		return clipInfo->trackCount <= (bodySize - sizeof(ClipMessage)) / sizeof(ClipTrackMessage);
+	}
+
+	return true; //HASHES_REQUESTED has no body
+}
@@ -0,0 +1,82 @@
+#ifndef MessageReceiver_H_
+#define MessageReceiver_H_
+
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "gameplay.h"
+#include "ComLib.h"
+#include "MessageTypes.h"
+
+using namespace gameplay;
+
+/**
+ * Drains the ComLib on an ingest thread so the render thread never waits on it.
+ * Every message is received straight into an arena, checked against the sizes it declares and parsed as far as it can be
+ * without the scene, then pushed on a bounded single producer / single consumer ring.
+ * Messages are taken in the order they arrived, so the arena is a ring as well and nothing is allocated per message.
+ * Only the render thread may take messages.
+ */
+class MessageReceiver
+{
+public:
+
+	struct Statistics {
+		size_t messagesReceived = 0;
+		size_t bytesReceived = 0;
+		size_t dropped = 0; //Shorter than their contents
+		double receiveSeconds = 0.0; //Spent receiving and parsing, not waiting
+		size_t peakQueuedBytes = 0;
+	};
+
+	//A message ready to be applied to the scene
+	struct Message {
+		char* data = NULL; //Starts with the MessageHeader, points into the arena until the message is popped
+		size_t size = 0;
+		size_t arenaSize = 0; //Taken from the arena, including any room skipped at its end
+		MessageType type = NONE;
+		Vector3 viewTranslation; //VIEW_CHANGED only, decomposed from the camera matrix
+		Quaternion viewRotation;
+	};
+
+	//Stops taking messages from the ComLib once queueSize messages are waiting or the arena of byteLimit bytes is full.
+	//The arena is never smaller than the ComLib buffer, so every message fits
+	MessageReceiver(ComLib& comLib, size_t queueSize, size_t byteLimit);
+	~MessageReceiver(); //Messages still queued are thrown away
+
+	const Message* front(); //NULL when nothing has arrived
+	void pop(); //Frees the message returned by front
+	size_t getBacklog() const; //Bytes received here or still in the ComLib that haven't been taken
+	Statistics getStatistics() const;
+
+private:
+
+	void ingestLoop();
+	bool parse(Message& message);
+
+	static const size_t ARENA_ALIGNMENT = 16; //Every message starts as aligned as it would from new[]
+
+	ComLib& _comLib; //Only touched by the ingest thread
+
+	char* _arena;
+	size_t _arenaSize;
+	std::atomic<size_t> _allocated; //Bytes ever taken from the arena, written by the ingest thread
+	std::atomic<size_t> _released; //Bytes ever given back, written by the render thread
+
+	std::vector<Message> _messages;
+	std::atomic<size_t> _head; //Next message to take, written by the render thread
+	std::atomic<size_t> _tail; //Next free slot, written by the ingest thread
+	std::atomic<size_t> _waitingBytes; //Of the ComLib buffer, sampled after every receive
+
+	std::atomic<size_t> _messagesReceived;
+	std::atomic<size_t> _bytesReceived;
+	std::atomic<size_t> _dropped;
+	std::atomic<long long> _receiveNanoseconds;
+	std::atomic<size_t> _peakQueuedBytes;
+
+	std::thread _thread;
+	std::atomic<bool> _stopping;
+};
+
+#endif
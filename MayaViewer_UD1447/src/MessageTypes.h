@@ -2,19 +2,35 @@
 
 #define NAME_SIZE 64
 #define PATH_SIZE 256
+#define MAX_SKIN_JOINTS 64 //The viewer shaders have room for this many joints, meshes with more are sent without a skin
 
 enum MessageType {
 	NONE,
 	MESH_ADDED,
 	MESH_REMOVED,
 	MESH_RENAMED,
-	MESH_TRANSFORM_CHANGED,
+	TRANSFORM_CHANGED,
 	MESH_TOPOLOGY_CHANGED,
 	CAMERA_ADDED,
 	VIEW_CHANGED,
 	MATERIAL_CHANGED,
 	LIGHT_ADDED,
-	LIGHT_REMOVED
+	LIGHT_REMOVED,
+	SCENE_SNAPSHOT,
+	TRANSFORM_REMOVED,
+	TRANSFORM_RENAMED,
+	MATERIAL_DEFINED,
+	MATERIAL_UPDATED,
+	MATERIAL_RENAMED,
+	LIGHT_CHANGED,
+	LIGHT_RENAMED,
+	HASHES_REQUESTED, //The viewer answers with CONTENT_HASHES on the viewer channel
+	CONTENT_HASHES,
+	SKIN_BOUND, //Sent before the vertices of a skinned mesh, no joints removes the skin
+	SKIN_POSED,
+	CLIP_REQUESTED, //The viewer asks for the playback range, the plugin answers with CLIP
+	CLIP,
+	MESH_REQUESTED //The viewer has nothing to share a duplicate with, the plugin sends the mesh again with its vertices
 };
 
 enum CameraType {
@@ -22,6 +38,19 @@ enum CameraType {
 	ORTHOGRAPHIC_CAM
 };
 
+enum TrackType {
+	TRANSFORM_TRACK, //Local translation, rotation and scale as in TransformMessage, 10 channels
+	CAMERA_TRACK, //World translation and rotation of the camera, 7 channels
+	SKIN_TRACK, //JointPoseMessage of every joint, 16 channels per joint
+	POINTS_TRACK //x, y, z of every point of the mesh
+};
+
+enum LightType {
+	POINT_LIGHT,
+	DIRECTIONAL_LIGHT,
+	SPOT_LIGHT
+};
+
 struct MessageHeader {
 	MessageType type = NONE;
 };
@@ -29,6 +58,22 @@ struct MessageHeader {
 struct MeshMessage {
 	char name[NAME_SIZE] = "\0";
 	char oldName[NAME_SIZE] = "\0";
+	char parentName[NAME_SIZE] = "\0"; //The transform the mesh is attached to
+	char materialName[NAME_SIZE] = "\0"; //Materials are sent once with MATERIAL_DEFINED and shared by every mesh using them
+	size_t vertexCount = 0;
+	size_t partCount = 0; //Set when the vertices are sent, one part per material the faces use
+	unsigned long long contentHash = 0; //Hash of the mesh data the vertices were built from, including the part materials
+	bool duplicate = false; //Sent with its parts but no vertices, the viewer shares the mesh it already has with the same contentHash
+};
+
+/*
+ * A run of vertices drawn with one material. Messages with vertices carry
+ * MeshMessage | MeshPartMessage[partCount] | VertexMessage[vertexCount]
+ * and the vertices are grouped so that every part is contiguous.
+ */
+struct MeshPartMessage {
+	char materialName[NAME_SIZE] = "\0"; //Empty for faces without a material
+	size_t firstVertex = 0;
 	size_t vertexCount = 0;
 };
 
@@ -39,7 +84,12 @@ struct VertexMessage {
 };
 
 struct TransformMessage {
-	float transformationMatrix[16] = { 0.0f };
+	char name[NAME_SIZE] = "\0";
+	char oldName[NAME_SIZE] = "\0";
+	char parentName[NAME_SIZE] = "\0"; //Empty when the transform is directly under the scene root
+	float translation[3] = { 0.0f }; //Local translation, rotation and scale, relative to the parent
+	float rotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f }; //Quaternion as x, y, z, w
+	float scale[3] = { 1.0f, 1.0f, 1.0f };
 };
 
 struct CameraMessage {
@@ -59,8 +109,104 @@ struct MaterialMessage {
 	float color[3] = { 0.0f };
 	char diffuseTexPath[PATH_SIZE] = "\0";
 	float specularPower = 0.0f;
+	unsigned long long contentHash = 0; //Hash of the values above, the names are not included
+};
+
+/*
+ * Layout of a SCENE_SNAPSHOT message (every section is contiguous):
+ * MessageType | SceneSnapshotMessage | CameraMessage[cameraCount] | MaterialMessage[materialCount]
+ * | TransformMessage[transformCount] | LightMessage[lightCount] | MeshMessage[meshCount] | MeshPartMessage[partCount] | VertexMessage[vertexCount]
+ * Transforms are ordered so that parents always come before their children.
+ * Every material is only sent once, meshes refer to it by name.
+ * The parts and the vertices of each mesh follow each other in the same order as the meshes.
+ * A mesh the viewer already has with the same contentHash is sent with no vertices.
+ */
+struct SceneSnapshotMessage {
+	size_t cameraCount = 0;
+	size_t materialCount = 0;
+	size_t transformCount = 0;
+	size_t lightCount = 0;
+	size_t meshCount = 0;
+	size_t partCount = 0; //Total amount of parts for all meshes in the snapshot
+	size_t vertexCount = 0; //Total amount of vertices for all meshes in the snapshot
 };
 
 struct LightMessage {
+	LightType type = POINT_LIGHT;
+	char name[NAME_SIZE] = "\0";
+	char oldName[NAME_SIZE] = "\0";
+	char parentName[NAME_SIZE] = "\0"; //The transform the light is attached to, the light points down its negative z axis
+	float color[3] = { 0.0f };
+	float intensity = 0.0f;
+	float range = 0.0f; //0 when the light has no decay
+	float innerAngle = 0.0f; //Spot lights only, half angles in radians
+	float outerAngle = 0.0f;
+};
+
+/*
+ * Layout of a CONTENT_HASHES message, sent by the viewer on the viewer channel:
+ * MessageType | ContentHashesMessage | ContentHashMessage[meshCount] | ContentHashMessage[materialCount]
+ * Lets the plugin skip sending meshes and materials the viewer already has after a reconnect.
+ */
+struct ContentHashesMessage {
+	size_t meshCount = 0;
+	size_t materialCount = 0;
+};
+
+struct ContentHashMessage {
+	char name[NAME_SIZE] = "\0";
+	unsigned long long contentHash = 0;
+};
+
+/*
+ * A mesh deformed by joints. The vertices of the mesh are sent in the bind pose,
+ * after that only the joint poses are streamed and the viewer does the skinning.
+ * SKIN_BOUND: MessageType | SkinMessage | JointMessage[jointCount] | SkinWeightMessage[vertexCount] | JointPoseMessage[jointCount]
+ * SKIN_POSED: MessageType | SkinMessage | JointPoseMessage[jointCount]
+ * The joints are ordered so that a parent always comes before its children.
+ * Matrices are in Maya's row order, which is the column order the viewer uses.
+ */
+struct SkinMessage {
+	char meshName[NAME_SIZE] = "\0";
+	size_t jointCount = 0;
+	size_t vertexCount = 0; //One weight per mesh vertex, 0 in SKIN_POSED
+	float bindShape[16] = { 0.0f }; //Places the bind pose vertices where they were when the skin was bound
+};
+
+struct JointMessage {
+	char name[NAME_SIZE] = "\0";
+	int parentIndex = -1; //-1 when no ancestor of the joint is in the skin, its pose is then in world space
+	float inverseBindPose[16] = { 0.0f };
+};
+
+struct JointPoseMessage {
+	float matrix[16] = { 0.0f }; //Relative to the parent joint
+};
+
+struct SkinWeightMessage {
+	float joints[4] = { 0.0f }; //Joint indices, stored as floats like the shaders read them
+	float weights[4] = { 0.0f }; //Sum up to one
+};
+
+/*
+ * A frame range baked in Maya for the viewer to play back on its own.
+ * Layout of a CLIP message:
+ * MessageType | ClipMessage | ClipTrackMessage[trackCount] | track data, in track order
+ * Track data: (VertexMessage[vertexCount] | unsigned int pointIndices[vertexCount]) | channel[channelCount]
+ * The vertices and point indices are only there for POINTS_TRACK, the mesh is rebuilt from them every frame.
+ * Every channel holds frameCount samples, encoded as in ClipCodec.h.
+ */
+struct ClipMessage {
+	size_t frameCount = 0;
+	float frameRate = 0.0f; //Frames per second
+	size_t currentFrame = 0; //The frame Maya was at, shown again when the playback stops
+	size_t trackCount = 0;
+};
 
+struct ClipTrackMessage {
+	char name[NAME_SIZE] = "\0"; //Transform, camera or mesh the track moves
+	TrackType type = TRANSFORM_TRACK;
+	size_t channelCount = 0;
+	size_t vertexCount = 0; //POINTS_TRACK only, the vertices of the mesh
+	size_t dataSize = 0; //Bytes of the track in the data section
 };
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "TextureCache.h"
+#include <sys/stat.h>
+
+static long long getModifiedTime(const char* path) {
+	struct stat info;
+	return stat(path, &info) == 0 ? (long long)info.st_mtime : 0;
+}
+
+TextureCache::TextureCache(unsigned int workerCount) : _placeholder(NULL), _stopping(false) {
+	for (unsigned int i = 0; i < workerCount; i++) {
+		_workers.push_back(std::thread(&TextureCache::workerLoop, this));
+	}
+}
+
+TextureCache::~TextureCache() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_wake.notify_all();
+	for (size_t i = 0; i < _workers.size(); i++) {
+		_workers[i].join();
+	}
+
+	for (size_t i = 0; i < _decoded.size(); i++) {
+		SAFE_RELEASE(_decoded[i].image);
+	}
+	for (auto& it : _entries) {
+		SAFE_RELEASE(it.second.texture);
+	}
+	SAFE_RELEASE(_placeholder);
+}
+
+void TextureCache::acquire(const char* path) {
+	long long modifiedTime = getModifiedTime(path);
+	auto it = _entries.find(path);
+	if (it != _entries.end()) {
+		it->second.refCount++;
+		if (it->second.modifiedTime == modifiedTime) { //Loaded or on its way
+			return;
+		}
+		it->second.modifiedTime = modifiedTime;
+	}
+	else {
+		_entries[path] = { NULL, modifiedTime, 1 };
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_requests.push_back({ path, modifiedTime, NULL });
+	}
+	_wake.notify_one();
+}
+
+void TextureCache::release(const char* path) {
+	auto it = _entries.find(path);
+	if (it != _entries.end() && --it->second.refCount <= 0) { //A decode still in flight is thrown away when it arrives
+		SAFE_RELEASE(it->second.texture);
+		_entries.erase(it);
+	}
+}
+
+Texture* TextureCache::getTexture(const char* path) {
+	auto it = _entries.find(path);
+	if (it != _entries.end() && it->second.texture) {
+		return it->second.texture;
+	}
+
+	if (_placeholder == NULL) { //Created on first use, the render thread has a context by then
+		unsigned char white[] = { 255, 255, 255, 255 };
+		_placeholder = Texture::create(Texture::RGBA, 1, 1, white);
+	}
+	return _placeholder;
+}
+
+void TextureCache::upload(size_t byteBudget, std::vector<std::string>& getUploaded) {
+	getUploaded.clear();
+	size_t uploaded = 0;
+	while (uploaded == 0 || uploaded < byteBudget) {
+		Job job;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_decoded.empty()) {
+				return;
+			}
+			job = _decoded.front();
+			_decoded.pop_front();
+		}
+
+		auto it = _entries.find(job.path);
+		if (it == _entries.end() || it->second.modifiedTime != job.modifiedTime || job.image == NULL) { //Released, replaced by a newer file or unreadable
+			if (job.image == NULL) {
+				std::cout << "The texture " << job.path << " could not be loaded" << std::endl; //Debug
+			}
+			SAFE_RELEASE(job.image);
+			continue;
+		}
+
+		uploaded += job.image->getWidth() * job.image->getHeight() * (job.image->getFormat() == Image::RGBA ? 4 : 3);
+		SAFE_RELEASE(it->second.texture);
+		it->second.texture = Texture::create(job.image, true);
+		SAFE_RELEASE(job.image);
+		getUploaded.push_back(job.path);
+	}
+}
+
+void TextureCache::workerLoop() {
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [&] { return _stopping || !_requests.empty(); });
+			if (_stopping) {
+				return;
+			}
+			job = _requests.front();
+			_requests.pop_front();
+		}
+
+		job.image = Image::create(job.path.c_str()); //Reading and decoding the file is the slow part, the upload is left for the render thread
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_decoded.push_back(job);
+	}
+}
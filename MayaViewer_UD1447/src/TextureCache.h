@@ -0,0 +1,62 @@
+#ifndef TextureCache_H_
+#define TextureCache_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "gameplay.h"
+
+using namespace gameplay;
+
+/**
+ * Shares one texture per image file between every material using it.
+ * Images are decoded on worker threads and uploaded on the render thread a few per frame,
+ * a file that changed on disk since it was loaded is decoded again the next time it is acquired.
+ */
+class TextureCache
+{
+public:
+
+	TextureCache(unsigned int workerCount);
+	~TextureCache();
+
+	void acquire(const char* path); //Every acquire is paired with a release
+	void release(const char* path);
+	Texture* getTexture(const char* path); //A white placeholder until the image has been uploaded
+
+	//Uploads decoded images until byteBudget is used, at least one per call. getUploaded lists the paths of the new textures
+	void upload(size_t byteBudget, std::vector<std::string>& getUploaded);
+
+private:
+
+	struct Entry {
+		Texture* texture;
+		long long modifiedTime; //Of the file the texture is, or is being, decoded from
+		int refCount;
+	};
+
+	struct Job {
+		std::string path;
+		long long modifiedTime;
+		Image* image; //NULL until decoded, or when the file couldn't be read
+	};
+
+	void workerLoop();
+
+	std::unordered_map<std::string, Entry> _entries; //Only touched by the render thread
+	Texture* _placeholder;
+
+	std::vector<std::thread> _workers;
+	std::mutex _mutex; //Guards the two queues and _stopping
+	std::condition_variable _wake;
+	std::deque<Job> _requests;
+	std::deque<Job> _decoded;
+	bool _stopping;
+};
+
+#endif